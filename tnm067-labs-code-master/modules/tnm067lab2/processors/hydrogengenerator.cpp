@@ -4,11 +4,133 @@
 #include <modules/base/algorithm/dataminmax.h>
 #include <inviwo/core/util/indexmapper.h>
 #include <inviwo/core/datastructures/volume/volumeram.h>
+#include <inviwo/core/datastructures/volume/volumeramprecision.h>
+#include <inviwo/core/util/formatdispatching.h>
+#include <inviwo/core/util/logcentral.h>
 #include <modules/base/algorithm/dataminmax.h>
+#include <modules/tnm067lab2/utils/datvolumeio.h>
 #include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <type_traits>
 
 namespace inviwo {
 
+namespace detail {
+
+// Mirrors scalar voxels, which are symmetric
+struct Unchanged {
+    template <typename T>
+    T operator()(const T& value, size_t) const {
+        return value;
+    }
+};
+
+// Mirrors gradient voxels, which change the sign of the component along the mirrored axis
+struct NegateAxis {
+    vec3 operator()(vec3 value, size_t axis) const {
+        value[axis] = -value[axis];
+        return value;
+    }
+};
+
+/**
+ * Fills the remaining seven octants of a volume from the octant at the low index corner, i.e.
+ * the voxels with pos < (dims + 1) / 2. First each evaluated row is mirrored in x, then the full
+ * rows are mirrored in y and finally the full slices in z, all as contiguous copies. Every copied
+ * voxel is passed through mirror(value, axis) for the axis it is mirrored along.
+ */
+template <typename T, typename Mirror = Unchanged>
+void mirrorOctant(T* data, size3_t dims, Mirror mirror = {}) {
+    const size3_t half = (dims + size3_t(1)) / size_t(2);
+    util::IndexMapper3D index(dims);
+    const auto along = [&](size_t axis) {
+        return [&mirror, axis](const T& value) { return mirror(value, axis); };
+    };
+
+    for (size_t z = 0; z < half.z; ++z) {
+        for (size_t y = 0; y < half.y; ++y) {
+            T* row = data + index(0, y, z);
+            std::transform(row, row + dims.x / 2, std::make_reverse_iterator(row + dims.x),
+                           along(0));
+        }
+        for (size_t y = 0; y < dims.y / 2; ++y) {
+            const T* src = data + index(0, y, z);
+            std::transform(src, src + dims.x, data + index(0, dims.y - 1 - y, z), along(1));
+        }
+    }
+    const size_t sliceSize = dims.x * dims.y;
+    for (size_t z = 0; z < dims.z / 2; ++z) {
+        const T* src = data + index(0, 0, z);
+        std::transform(src, src + sliceSize, data + index(0, 0, dims.z - 1 - z), along(2));
+    }
+}
+
+/**
+ * Evaluates voxelValue(pos) for every voxel of the volume. If exploitSymmetry is set only the
+ * octant at the low index corner is evaluated and mirrored into the rest of the volume, see
+ * mirrorOctant.
+ */
+template <typename T, typename F, typename Mirror = Unchanged>
+void fillVolume(T* data, size3_t dims, bool exploitSymmetry, F voxelValue, Mirror mirror = {}) {
+    util::IndexMapper3D index(dims);
+    // The octant includes the center planes for odd sizes
+    const size3_t extent = exploitSymmetry ? (dims + size3_t(1)) / size_t(2) : dims;
+
+    size3_t pos{};
+    for (pos.z = 0; pos.z < extent.z; ++pos.z) {
+        for (pos.y = 0; pos.y < extent.y; ++pos.y) {
+            for (pos.x = 0; pos.x < extent.x; ++pos.x) {
+                data[index(pos)] = voxelValue(pos);
+            }
+        }
+    }
+    if (exploitSymmetry) {
+        mirrorOctant(data, dims, mirror);
+    }
+}
+
+// Converts a value to the voxel type, integer types interpret the value as normalized to [0, 1]
+template <typename T>
+T toVoxel(double value) {
+    if constexpr (std::is_integral<T>::value) {
+        return static_cast<T>(std::min(value, 1.0) * std::numeric_limits<T>::max() + 0.5);
+    } else {
+        return static_cast<T>(static_cast<float>(value));
+    }
+}
+
+// Sets the ranges of a gradient volume symmetrically to the largest component
+void setGradientRange(Volume& volume, const VolumeRAM* ram) {
+    const auto minMax = util::volumeMinMax(ram);
+    double extent = 0.0;
+    for (size_t i = 0; i < 3; ++i) {
+        extent = std::max({extent, std::abs(minMax.first[i]), std::abs(minMax.second[i])});
+    }
+    volume.dataMap_.dataRange = volume.dataMap_.valueRange = dvec2(-extent, extent);
+}
+
+const DataFormatBase* dataFormat(HydrogenGenerator::OutputFormat format) {
+    switch (format) {
+        case HydrogenGenerator::OutputFormat::Float16:
+            return DataFloat16::get();
+        case HydrogenGenerator::OutputFormat::UInt16:
+            return DataUInt16::get();
+        case HydrogenGenerator::OutputFormat::UInt8:
+            return DataUInt8::get();
+        case HydrogenGenerator::OutputFormat::Float32:
+        default:
+            return DataFloat32::get();
+    }
+}
+
+}  // namespace detail
+
 const ProcessorInfo HydrogenGenerator::processorInfo_{
     "org.inviwo.HydrogenGenerator",  // Class identifier
     "Hydrogen Generator",            // Display name
@@ -20,27 +142,233 @@ const ProcessorInfo HydrogenGenerator::processorInfo_{
 const ProcessorInfo HydrogenGenerator::getProcessorInfo() const { return processorInfo_; }
 
 HydrogenGenerator::HydrogenGenerator()
-    : Processor(), volume_("volume"), size_("size_", "Volume Size", 16, 4, 256) {
+    : Processor()
+    , volume_("volume")
+    , gradient_("gradient")
+    , bricks_("bricks")
+    , size_("size_", "Volume Size", 16, 4, 512)
+    , n_("n", "Principal Quantum Number (n)", 3, 1, 6)
+    , l_("l", "Azimuthal Quantum Number (l)", 2, 0, 2)
+    , m_("m", "Magnetic Quantum Number (m)", 0, -2, 2)
+    , exploitSymmetry_("exploitSymmetry", "Evaluate One Octant", true)
+    , outputFormat_("outputFormat", "Output Format",
+                    {{"float32", "Float 32", OutputFormat::Float32},
+                     {"float16", "Float 16 (normalized)", OutputFormat::Float16},
+                     {"uint16", "UInt 16 (normalized)", OutputFormat::UInt16},
+                     {"uint8", "UInt 8 (normalized)", OutputFormat::UInt8}},
+                    0)
+    , useCache_("useCache", "Cache Volumes on Disk", false)
+    , cacheDirectory_(
+          "cacheDirectory", "Cache Directory",
+          (std::filesystem::temp_directory_path() / "tnm067-hydrogen-cache").string())
+    , brickedSize_("brickedSize", "Bricked Volume Size", 1024, 32, 4096)
+    , brickCacheSize_("brickCacheSize", "Brick Cache Size (MB)", 2048, 64, 65536) {
     addPort(volume_);
+    addPort(gradient_);
+    addPort(bricks_);
     addProperty(size_);
+    addProperty(n_);
+    addProperty(l_);
+    addProperty(m_);
+    addProperty(exploitSymmetry_);
+    addProperty(outputFormat_);
+    addProperty(useCache_);
+    addProperty(cacheDirectory_);
+    addProperty(brickedSize_);
+    addProperty(brickCacheSize_);
+
+    n_.onChange([this]() { l_.setMaxValue(n_.get() - 1); });
+    l_.onChange([this]() {
+        m_.setMinValue(-l_.get());
+        m_.setMaxValue(l_.get());
+    });
+}
+
+std::shared_ptr<const HydrogenOrbital> HydrogenGenerator::getOrbital() {
+    const int n = n_.get();
+    const int l = glm::clamp(l_.get(), 0, n - 1);
+    const int m = glm::clamp(m_.get(), -l, l);
+
+    auto& orbital = orbitals_[std::make_tuple(n, l, m)];
+    if (!orbital) {
+        orbital = std::make_shared<HydrogenOrbital>(n, l, m);
+    }
+    return orbital;
+}
+
+std::string HydrogenGenerator::cacheFile() const {
+    const int n = n_.get();
+    const int l = glm::clamp(l_.get(), 0, n - 1);
+    const int m = glm::clamp(m_.get(), -l, l);
+
+    // Bump the version whenever the generated voxel values change
+    std::ostringstream params;
+    params << "HydrogenGenerator v1 n=" << n << " l=" << l << " m=" << m << " size=" << size_.get()
+           << " format=" << static_cast<int>(outputFormat_.get())
+           << " tableSize=" << HydrogenOrbital::tableSize;
+
+    // FNV-1a, stable across platforms and runs unlike std::hash
+    std::uint64_t hash = 14695981039346656037ull;
+    for (const char c : params.str()) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    std::ostringstream name;
+    name << "hydrogen-" << std::hex << std::setw(16) << std::setfill('0') << hash << ".dat";
+    return (std::filesystem::path(cacheDirectory_.get()) / name.str()).string();
 }
 
 void HydrogenGenerator::process() {
-    auto vol = std::make_shared<Volume>(size3_t(size_), DataFloat32::get());
+    if (volume_.isConnected()) {
+        std::shared_ptr<Volume> gradient;
+        volume_.setData(generateVolume(gradient_.isConnected() ? &gradient : nullptr));
+        if (gradient) {
+            gradient_.setData(gradient);
+        }
+    } else if (gradient_.isConnected()) {
+        gradient_.setData(generateGradient());
+    }
+    if (bricks_.isConnected()) {
+        bricks_.setData(generateBricks());
+    }
+}
+
+std::shared_ptr<Volume> HydrogenGenerator::generateVolume(std::shared_ptr<Volume>* gradient) {
+    const std::string cached = useCache_ ? cacheFile() : std::string();
+    if (useCache_ && std::filesystem::exists(cached)) {
+        try {
+            auto vol = util::readDatVolume(cached);
+            if (gradient) {
+                *gradient = generateGradient();
+            }
+            return vol;
+        } catch (const Exception& e) {
+            LogWarn("Ignoring cached volume: " << e.getMessage());
+        }
+    }
 
+    const auto orbital = getOrbital();
+    const auto format = outputFormat_.get();
+
+    auto vol = std::make_shared<Volume>(size3_t(size_), detail::dataFormat(format));
+    vol->setModelMatrix(HydrogenOrbital::modelMatrix());
     auto ram = vol->getEditableRepresentation<VolumeRAM>();
-    auto data = static_cast<float*>(ram->getData());
-    util::IndexMapper3D index(ram->getDimensions());
+    const size3_t dims = ram->getDimensions();
+
+    // Float32 stores the density as is, the other formats store density / maxDensity in [0, 1]
+    const double maxDensity = orbital->maxDensity();
+    const double scale = format == OutputFormat::Float32 ? 1.0 : 1.0 / maxDensity;
+
+    // The gradient is written in the same pass, from the subexpressions of the density
+    std::shared_ptr<Volume> gradientVolume;
+    vec3* gradientData = nullptr;
+    if (gradient) {
+        gradientVolume = std::make_shared<Volume>(dims, DataVec3Float32::get());
+        gradientVolume->setModelMatrix(HydrogenOrbital::modelMatrix());
+        gradientData = static_cast<vec3*>(
+            gradientVolume->getEditableRepresentation<VolumeRAM>()->getData());
+    }
+    util::IndexMapper3D index(dims);
 
-    util::forEachVoxel(*ram, [&](const size3_t& pos) {
-        vec3 cartesian = idTOCartesian(pos);
-        data[index(pos)] = static_cast<float>(eval(cartesian));
+    ram->dispatch<void, dispatching::filter::Scalars>([&](auto vrprecision) {
+        using ValueType = util::PrecisionValueType<decltype(vrprecision)>;
+        detail::fillVolume(vrprecision->getDataTyped(), dims, exploitSymmetry_.get(),
+                           [&](const size3_t& pos) {
+                               if (!gradientData) {
+                                   const double density = orbital->density(idTOCartesian(pos));
+                                   return detail::toVoxel<ValueType>(density * scale);
+                               }
+                               dvec3 g;
+                               const double density = orbital->density(idTOCartesian(pos), g);
+                               gradientData[index(pos)] = vec3(g);
+                               return detail::toVoxel<ValueType>(density * scale);
+                           });
     });
+    if (gradient) {
+        if (exploitSymmetry_) {
+            detail::mirrorOctant(gradientData, dims, detail::NegateAxis{});
+        }
+        detail::setGradientRange(*gradientVolume,
+                                 gradientVolume->getRepresentation<VolumeRAM>());
+        *gradient = gradientVolume;
+    }
+
+    switch (format) {
+        case OutputFormat::Float32: {
+            auto minMax = util::volumeMinMax(ram);
+            vol->dataMap_.dataRange = vol->dataMap_.valueRange =
+                dvec2(minMax.first.x, minMax.second.x);
+            break;
+        }
+        case OutputFormat::Float16:
+            vol->dataMap_.dataRange = dvec2(0.0, 1.0);
+            vol->dataMap_.valueRange = dvec2(0.0, maxDensity);
+            break;
+        case OutputFormat::UInt16:
+            vol->dataMap_.dataRange = dvec2(0.0, std::numeric_limits<std::uint16_t>::max());
+            vol->dataMap_.valueRange = dvec2(0.0, maxDensity);
+            break;
+        case OutputFormat::UInt8:
+            vol->dataMap_.dataRange = dvec2(0.0, std::numeric_limits<std::uint8_t>::max());
+            vol->dataMap_.valueRange = dvec2(0.0, maxDensity);
+            break;
+    }
+
+    if (useCache_) {
+        try {
+            std::filesystem::create_directories(cacheDirectory_.get());
+            util::writeDatVolume(*vol, cached);
+        } catch (const std::exception& e) {
+            LogWarn("Could not cache the volume: " << e.what());
+        }
+    }
+
+    return vol;
+}
 
-    auto minMax = util::volumeMinMax(ram);
-    vol->dataMap_.dataRange = vol->dataMap_.valueRange = dvec2(minMax.first.x, minMax.second.x);
+std::shared_ptr<Volume> HydrogenGenerator::generateGradient() {
+    const auto orbital = getOrbital();
 
-    volume_.setData(vol);
+    auto vol = std::make_shared<Volume>(size3_t(size_), DataVec3Float32::get());
+    vol->setModelMatrix(HydrogenOrbital::modelMatrix());
+    auto ram = vol->getEditableRepresentation<VolumeRAM>();
+    detail::fillVolume(static_cast<vec3*>(ram->getData()), ram->getDimensions(),
+                       exploitSymmetry_.get(),
+                       [&](const size3_t& pos) {
+                           dvec3 g;
+                           orbital->density(idTOCartesian(pos), g);
+                           return vec3(g);
+                       },
+                       detail::NegateAxis{});
+    detail::setGradientRange(*vol, ram);
+    return vol;
+}
+
+std::shared_ptr<BrickedVolume> HydrogenGenerator::generateBricks() {
+    const auto orbital = getOrbital();
+    const size_t size = brickedSize_.get();
+
+    auto bricks = std::make_shared<BrickedVolume>(
+        size3_t(size),
+        [orbital, size](size3_t offset, size3_t dims, float* data) {
+            util::IndexMapper3D index(dims);
+            size3_t pos{};
+            for (pos.z = 0; pos.z < dims.z; ++pos.z) {
+                for (pos.y = 0; pos.y < dims.y; ++pos.y) {
+                    for (pos.x = 0; pos.x < dims.x; ++pos.x) {
+                        data[index(pos)] = static_cast<float>(
+                            orbital->density(idTOCartesian(offset + pos, size)));
+                    }
+                }
+            }
+        },
+        [orbital, size](size3_t first, size3_t last) {
+            return dvec2(0.0, orbital->maxDensity(idTOCartesian(first, size),
+                                                  idTOCartesian(last, size)));
+        },
+        brickCacheSize_.get() << 20);
+
+    bricks->setModelMatrix(HydrogenOrbital::modelMatrix());
+    return bricks;
 }
 
 vec3 HydrogenGenerator::cartesianToSphereical(vec3 cartesian) {
@@ -77,6 +405,9 @@ vec3 HydrogenGenerator::cartesianToSphereical(vec3 cartesian) {
 }
 
 double HydrogenGenerator::eval(vec3 cartesian) {
+    // The density only depends on r and |cos(theta)|. Evaluating in the first octant makes the
+    // result exactly mirror symmetric, also in floating point.
+    cartesian = glm::abs(cartesian);
     vec3 sph = HydrogenGenerator::cartesianToSphereical(cartesian);
 
     double r = sph.x;
@@ -92,10 +423,19 @@ double HydrogenGenerator::eval(vec3 cartesian) {
     return density;
 }
 
-vec3 HydrogenGenerator::idTOCartesian(size3_t pos) {
-    vec3 p(pos);
-    p /= size_ - 1;
-    return p * (36.0f) - 18.0f;
+vec3 HydrogenGenerator::idTOCartesian(size3_t pos) { return idTOCartesian(pos, size_.get()); }
+
+vec3 HydrogenGenerator::idTOCartesian(size3_t pos, size_t size) {
+    // Indices in the upper half are computed from their mirrored index, that way pos and
+    // size - 1 - pos always map to exactly negated coordinates
+    const size_t last = size - 1;
+    vec3 p;
+    for (size_t i = 0; i < 3; ++i) {
+        const bool upper = 2 * pos[i] > last;
+        const float t = static_cast<float>(upper ? last - pos[i] : pos[i]) / last;
+        p[i] = upper ? 18.0f - t * 36.0f : t * 36.0f - 18.0f;
+    }
+    return p;
 }
 
 }  // namespace inviwo
@@ -3,13 +3,29 @@
 #include <modules/tnm067lab2/tnm067lab2moduledefine.h>
 #include <inviwo/core/processors/processor.h>
 #include <inviwo/core/properties/ordinalproperty.h>
+#include <inviwo/core/properties/boolproperty.h>
+#include <inviwo/core/properties/optionproperty.h>
+#include <inviwo/core/properties/directoryproperty.h>
 #include <inviwo/core/ports/imageport.h>
 #include <inviwo/core/ports/volumeport.h>
+#include <inviwo/core/ports/dataoutport.h>
+#include <modules/tnm067lab2/utils/hydrogenorbital.h>
+#include <modules/tnm067lab2/utils/brickedvolume.h>
+
+#include <map>
+#include <memory>
+#include <tuple>
 
 namespace inviwo {
 
 class IVW_MODULE_TNM067LAB2_API HydrogenGenerator : public Processor {
 public:
+    /**
+     * Voxel format of the generated volume. All formats but Float32 store the density normalized
+     * by HydrogenOrbital::maxDensity and map it back through the dataMap_ of the volume.
+     */
+    enum class OutputFormat { Float32, Float16, UInt16, UInt8 };
+
     HydrogenGenerator();
     virtual ~HydrogenGenerator() = default;
 
@@ -19,14 +35,57 @@ public:
     static const ProcessorInfo processorInfo_;
 
     static vec3 cartesianToSphereical(vec3 cartesian);
+    /**
+     * Closed form density of the 3d_z^2 orbital (n, l, m) = (3, 2, 0), used as reference for the
+     * tabulated HydrogenOrbital
+     */
     static double eval(vec3 cartesian);
 
     vec3 idTOCartesian(size3_t pos);
+    static vec3 idTOCartesian(size3_t pos, size_t size);
 
 private:
+    std::shared_ptr<const HydrogenOrbital> getOrbital();
+    /**
+     * Generates the density volume. If gradient is not null it is set to the gradient volume of
+     * generateGradient, which is then filled in the same pass as the density.
+     */
+    std::shared_ptr<Volume> generateVolume(std::shared_ptr<Volume>* gradient);
+    /**
+     * Creates a vec3 volume of the gradient of the density, see HydrogenOrbital::density. The
+     * gradient is in density per Bohr radius along the axes of the volume, regardless of the
+     * output format, so consumers get exact normals without finite differences.
+     */
+    std::shared_ptr<Volume> generateGradient();
+    /**
+     * Creates a volume of brickedSize_^3 voxels that evaluates its bricks on first access, with
+     * HydrogenOrbital::maxDensity as bound so consumers can skip empty regions. At most
+     * brickCacheSize_ MB of generated bricks are retained.
+     */
+    std::shared_ptr<BrickedVolume> generateBricks();
+    /**
+     * Path of the .dat file caching the volume for the current parameters. The name is a hash of
+     * every parameter the voxel values depend on.
+     */
+    std::string cacheFile() const;
+
     VolumeOutport volume_;
+    VolumeOutport gradient_;
+    DataOutport<BrickedVolume> bricks_;
 
     IntSizeTProperty size_;
+    IntProperty n_;
+    IntProperty l_;
+    IntProperty m_;
+    BoolProperty exploitSymmetry_;
+    TemplateOptionProperty<OutputFormat> outputFormat_;
+    BoolProperty useCache_;
+    DirectoryProperty cacheDirectory_;
+    IntSizeTProperty brickedSize_;
+    IntSizeTProperty brickCacheSize_;
+
+    // Tables are independent of size_ and kept for every orbital generated so far
+    std::map<std::tuple<int, int, int>, std::shared_ptr<const HydrogenOrbital>> orbitals_;
 };
 
 }  // namespace inviwo
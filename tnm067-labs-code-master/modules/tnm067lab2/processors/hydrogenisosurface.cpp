@@ -0,0 +1,58 @@
+#include <modules/tnm067lab2/processors/hydrogenisosurface.h>
+#include <modules/tnm067lab2/utils/orbitalsurface.h>
+#include <inviwo/core/datastructures/geometry/basicmesh.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace inviwo {
+
+const ProcessorInfo HydrogenIsosurface::processorInfo_{
+    "org.inviwo.HydrogenIsosurface",  // Class identifier
+    "Hydrogen Isosurface",            // Display name
+    "TNM067",                         // Category
+    CodeState::Experimental,          // Code state
+    Tags::CPU,                        // Tags
+};
+const ProcessorInfo HydrogenIsosurface::getProcessorInfo() const { return processorInfo_; }
+
+HydrogenIsosurface::HydrogenIsosurface()
+    : Processor()
+    , mesh_("mesh")
+    , n_("n", "Principal Quantum Number (n)", 3, 1, 6)
+    , l_("l", "Azimuthal Quantum Number (l)", 2, 0, 2)
+    , m_("m", "Magnetic Quantum Number (m)", 0, -2, 2)
+    , isoValue_("isoValue", "ISO value (of max density)", 0.05, 0.0, 1.0, 0.001)
+    , depth_("depth", "Octree Depth", 8, 3, 12)
+    , threads_("threads", "Threads",
+               std::max(size_t{1}, size_t{std::thread::hardware_concurrency()}), 1, 64) {
+
+    addPort(mesh_);
+
+    addProperty(n_);
+    addProperty(l_);
+    addProperty(m_);
+    addProperty(isoValue_);
+    addProperty(depth_);
+    addProperty(threads_);
+
+    n_.onChange([this]() { l_.setMaxValue(n_.get() - 1); });
+    l_.onChange([this]() {
+        m_.setMinValue(-l_.get());
+        m_.setMaxValue(l_.get());
+    });
+}
+
+void HydrogenIsosurface::process() {
+    const int n = n_.get();
+    const int l = glm::clamp(l_.get(), 0, n - 1);
+    const int m = glm::clamp(m_.get(), -l, l);
+    if (!orbital_ || orbital_->n() != n || orbital_->l() != l || orbital_->m() != m) {
+        orbital_ = std::make_shared<HydrogenOrbital>(n, l, m);
+    }
+
+    mesh_.setData(util::extractOrbitalSurface(*orbital_, isoValue_.get() * orbital_->maxDensity(),
+                                              depth_.get(), threads_.get()));
+}
+
+}  // namespace inviwo
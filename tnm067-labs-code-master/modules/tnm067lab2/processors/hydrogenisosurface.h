@@ -0,0 +1,44 @@
+#pragma once
+
+#include <modules/tnm067lab2/tnm067lab2moduledefine.h>
+#include <inviwo/core/processors/processor.h>
+#include <inviwo/core/properties/ordinalproperty.h>
+#include <inviwo/core/ports/meshport.h>
+#include <modules/tnm067lab2/utils/hydrogenorbital.h>
+
+#include <memory>
+
+namespace inviwo {
+
+/**
+ * Extracts an iso surface of a hydrogen orbital directly from the density function, refining an
+ * octree only where the surface can be, see util::extractOrbitalSurface. The surface matches the
+ * one of MarchingTetrahedra on a HydrogenGenerator volume of the same resolution, but no volume
+ * is stored, which allows resolutions beyond what fits in memory.
+ */
+class IVW_MODULE_TNM067LAB2_API HydrogenIsosurface : public Processor {
+public:
+    HydrogenIsosurface();
+    virtual ~HydrogenIsosurface() = default;
+
+    virtual void process() override;
+
+    virtual const ProcessorInfo getProcessorInfo() const override;
+    static const ProcessorInfo processorInfo_;
+
+private:
+    MeshOutport mesh_;
+
+    IntProperty n_;
+    IntProperty l_;
+    IntProperty m_;
+    // Density of the surface as a fraction of HydrogenOrbital::maxDensity
+    DoubleProperty isoValue_;
+    // The finest cells are 36 / 2^depth Bohr radii wide, like a volume of 2^depth + 1 voxels
+    IntSizeTProperty depth_;
+    IntSizeTProperty threads_;
+
+    std::shared_ptr<const HydrogenOrbital> orbital_;
+};
+
+}  // namespace inviwo
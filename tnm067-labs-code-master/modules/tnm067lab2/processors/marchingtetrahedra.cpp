@@ -1,13 +1,595 @@
 #include <modules/tnm067lab2/processors/marchingtetrahedra.h>
 #include <inviwo/core/datastructures/geometry/basicmesh.h>
 #include <inviwo/core/datastructures/volume/volumeram.h>
+#include <inviwo/core/datastructures/volume/volumeramprecision.h>
+#include <inviwo/core/util/formatdispatching.h>
 #include <inviwo/core/util/indexmapper.h>
 #include <inviwo/core/util/assertion.h>
 #include <inviwo/core/network/networklock.h>
+#include <inviwo/core/datastructures/buffer/bufferram.h>
+#include <inviwo/core/util/glm.h>
+#include <inviwo/core/common/inviwoapplication.h>
+#include <modules/tnm067lab2/utils/normalencoding.h>
+#include <modules/tnm067lab2/utils/datvolumeio.h>
+#include <modules/tnm067lab2/utils/mappedfile.h>
+#include <modules/tnm067lab2/utils/tetrahedroncases.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 namespace inviwo {
 
-size_t MarchingTetrahedra::HashFunc::max = 1;
+namespace {
+
+using detail::TetrahedronCase;
+using detail::tetrahedraIds;
+using detail::tetrahedronCases;
+using detail::tetrahedronEdges;
+
+// The five tetrahedra of cells with even and odd x + y + z, a central one and four corners, all
+// positively oriented. The face diagonals alternate between neighboring cells, so they match.
+constexpr size_t fiveTetrahedraIds[2][5][4] = {
+    {{1, 2, 4, 7}, {0, 1, 2, 4}, {3, 2, 1, 7}, {5, 1, 4, 7}, {6, 4, 2, 7}},
+    {{0, 5, 3, 6}, {1, 3, 0, 5}, {2, 0, 3, 6}, {4, 5, 0, 6}, {7, 3, 5, 6}}};
+
+// The twelve edges of a cell as pairs of its voxels, voxel k has x = k & 1, y = (k >> 1) & 1 and
+// z = k >> 2
+constexpr size_t cubeEdges[12][2] = {{0, 1}, {2, 3}, {4, 5}, {6, 7}, {0, 2}, {1, 3},
+                                     {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+
+struct CubeCase {
+    size_t triangleCount;
+    size_t triangles[10][3];  // indices into cubeEdges
+};
+
+/**
+ * Generates the triangles of the 256 marching cubes cases, bit k of the case is set if voxel k is
+ * below the iso value. On every face of the cell the surface crosses, segments run between the
+ * crossed edges such that the voxels below are separated on ambiguous faces. This only depends on
+ * the face, so neighboring cells agree and the surface has no cracks. Oriented so that the vertices
+ * below lie to the left when a face is viewed from outside, the segments form closed loops that
+ * are triangulated as fans facing the vertices below. The fans start at a vertex whose diagonals
+ * do not lie within a face, where they could coincide with the diagonals of the neighboring cell.
+ */
+constexpr std::array<CubeCase, 256> makeCubeCases() {
+    // The faces with their voxels counterclockwise when viewed from outside
+    constexpr size_t faces[6][4] = {{0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4},
+                                    {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6}};
+    const auto edge = [](size_t a, size_t b) {
+        size_t e = 0;
+        while (cubeEdges[e][0] != std::min(a, b) || cubeEdges[e][1] != std::max(a, b)) {
+            ++e;
+        }
+        return e;
+    };
+    const auto onFace = [](const size_t* face, size_t e) {
+        size_t count = 0;
+        for (size_t k = 0; k < 4; ++k) {
+            count += face[k] == cubeEdges[e][0] || face[k] == cubeEdges[e][1];
+        }
+        return count == 2;
+    };
+    const auto shareFace = [&](size_t e0, size_t e1) {
+        for (const auto& face : faces) {
+            if (onFace(face, e0) && onFace(face, e1)) return true;
+        }
+        return false;
+    };
+    constexpr size_t none = 12;
+
+    std::array<CubeCase, 256> cases{};
+    for (size_t caseId = 0; caseId < 256; ++caseId) {
+        const auto below = [&](size_t k) { return ((caseId >> k) & 1) != 0; };
+
+        // next[e] is the end of the segment that starts on edge e
+        size_t next[12] = {none, none, none, none, none, none,
+                           none, none, none, none, none, none};
+        for (const auto& face : faces) {
+            for (size_t k = 0; k < 4; ++k) {
+                if (!below(face[k]) || below(face[(k + 1) % 4])) continue;
+                // Walk backwards to the edge where the voxels below were entered
+                size_t j = (k + 3) % 4;
+                while (below(face[j]) || !below(face[(j + 1) % 4])) {
+                    j = (j + 3) % 4;
+                }
+                next[edge(face[k], face[(k + 1) % 4])] = edge(face[j], face[(j + 1) % 4]);
+            }
+        }
+
+        auto& c = cases[caseId];
+        bool visited[12] = {};
+        for (size_t start = 0; start < 12; ++start) {
+            if (next[start] == none || visited[start]) continue;
+            size_t loop[12] = {};
+            size_t length = 0;
+            for (size_t e = start; !visited[e]; e = next[e]) {
+                visited[e] = true;
+                loop[length++] = e;
+            }
+            size_t first = 0;
+            const auto validFan = [&](size_t f) {
+                for (size_t k = 2; k + 1 < length; ++k) {
+                    if (shareFace(loop[f], loop[(f + k) % length])) return false;
+                }
+                return true;
+            };
+            while (!validFan(first)) {
+                // Fails the compilation if a loop can not be triangulated this way
+                if (++first == length) throw std::logic_error("No fan for marching cubes loop");
+            }
+            for (size_t k = 1; k + 1 < length; ++k) {
+                auto& triangle = c.triangles[c.triangleCount++];
+                triangle[0] = loop[first];
+                triangle[1] = loop[(first + k) % length];
+                triangle[2] = loop[(first + k + 1) % length];
+            }
+        }
+    }
+    return cases;
+}
+
+constexpr std::array<CubeCase, 256> cubeCases = makeCubeCases();
+
+/**
+ * Returns a threshold in the voxel type, or a wider type, such that value < threshold exactly
+ * when value < iso. This keeps the case computation of integer volumes in integers.
+ */
+template <typename T>
+auto isoThreshold(float iso) {
+    if constexpr (std::is_integral<T>::value) {
+        const double limit = std::ldexp(1.0, 62);
+        const double lowest =
+            std::max(static_cast<double>(std::numeric_limits<T>::lowest()), -limit);
+        const double highest =
+            std::min(static_cast<double>(std::numeric_limits<T>::max()) + 1.0, limit);
+        return static_cast<std::int64_t>(
+            std::clamp(std::ceil(static_cast<double>(iso)), lowest, highest));
+    } else {
+        return iso;
+    }
+}
+
+/**
+ * Adds the vertex of level on the edge between voxel k0 and k1 of cell c, gradient(k) returns the
+ * gradient at voxel k. The vertex normal is interpolated from the gradients and points towards
+ * lower values, like the triangles.
+ */
+template <typename Gradient>
+std::uint32_t addEdgeVertex(MarchingTetrahedra::MeshHelper& mesh,
+                            const MarchingTetrahedra::Cell& c, size_t k0, size_t k1, float iso,
+                            size_t level, Gradient& gradient) {
+    using Voxel = MarchingTetrahedra::Voxel;
+
+    // Interpolate from the lower voxel index, neighboring cells get the same vertex
+    if (c.voxels[k1].index < c.voxels[k0].index) std::swap(k0, k1);
+    const Voxel& v0 = c.voxels[k0];
+    const Voxel& v1 = c.voxels[k1];
+
+    return mesh.addVertex(
+        v0.index, v1.index,
+        [&]() {
+            const float s = (iso - v0.value) / (v1.value - v0.value);
+            const vec3 g = glm::mix(gradient(k0), gradient(k1), s);
+            const float length = glm::length(g);
+            return std::make_pair(v0.pos + s * (v1.pos - v0.pos),
+                                  length > 0.0f ? -g / length : vec3(0.0f));
+        },
+        level);
+}
+
+/**
+ * Extracts the triangles of the given tetrahedra of cell c into level. Bit k of below is set if
+ * voxel k of the cell is below the iso value, see addEdgeVertex for gradient.
+ */
+template <size_t N, typename Gradient>
+void extractTetrahedra(MarchingTetrahedra::MeshHelper& mesh, const size_t (&tetrahedra)[N][4],
+                       const MarchingTetrahedra::Cell& c, unsigned below, float iso, size_t level,
+                       Gradient& gradient) {
+    for (const auto& ids : tetrahedra) {
+        const unsigned caseId = ((below >> ids[0]) & 1u) << 3 | ((below >> ids[1]) & 1u) << 2 |
+                                ((below >> ids[2]) & 1u) << 1 | ((below >> ids[3]) & 1u);
+        const TetrahedronCase& tetrahedronCase = tetrahedronCases[caseId];
+
+        for (size_t t = 0; t < tetrahedronCase.triangleCount; ++t) {
+            std::uint32_t triangle[3];
+            for (size_t k = 0; k < 3; ++k) {
+                const auto& edge = tetrahedronEdges[tetrahedronCase.triangles[t][k]];
+                triangle[k] =
+                    addEdgeVertex(mesh, c, ids[edge[0]], ids[edge[1]], iso, level, gradient);
+            }
+            mesh.addTriangle(triangle[0], triangle[1], triangle[2], level);
+        }
+    }
+}
+
+/**
+ * Extracts the marching cubes triangles of cell c, see extractTetrahedra for the parameters
+ */
+template <typename Gradient>
+void extractCube(MarchingTetrahedra::MeshHelper& mesh, const MarchingTetrahedra::Cell& c,
+                 unsigned below, float iso, size_t level, Gradient& gradient) {
+    const CubeCase& cubeCase = cubeCases[below];
+    for (size_t t = 0; t < cubeCase.triangleCount; ++t) {
+        std::uint32_t triangle[3];
+        for (size_t k = 0; k < 3; ++k) {
+            const auto& edge = cubeEdges[cubeCase.triangles[t][k]];
+            triangle[k] = addEdgeVertex(mesh, c, edge[0], edge[1], iso, level, gradient);
+        }
+        mesh.addTriangle(triangle[0], triangle[1], triangle[2], level);
+    }
+}
+
+// Default of the layerDone callback of sweepCells
+struct IgnoreLayer {
+    void operator()(size_t) const {}
+};
+
+/**
+ * Visits the cells of the layers [zBegin, zEnd) of a volume with dimensions dims, one layer of
+ * cells at a time, and extracts the surface of isos[l] into level l of mesh. The voxels of a cell
+ * are loaded once for all iso values. The cells are grouped into blocks of blockSize^3 cells and
+ * only the blocks in activeBlocks (linear indices, x fastest, increasing) are visited, or all
+ * blocks if activeBlocks is nullptr. The cells are triangulated by method.
+ * getSlice(z, T* scratch) returns the voxels of slice z with x running fastest, either pointing
+ * into the volume or into scratch after filling it. It has to provide the voxels of the active
+ * blocks and their direct neighbors, which are needed for the central differences of the
+ * gradients. At most four slices are held in memory. layerDone(z) is called after the layer of
+ * cells z is extracted, e.g. to flush the mesh.
+ */
+template <typename T, typename GetSlice, typename LayerDone = IgnoreLayer>
+void sweepCells(MarchingTetrahedra::MeshHelper& mesh, const size3_t& dims,
+                size_t zBegin, size_t zEnd, const std::vector<float>& isos,
+                MarchingTetrahedra::Method method, size_t blockSize,
+                const std::vector<size_t>* activeBlocks, GetSlice getSlice,
+                LayerDone layerDone = {}) {
+    if (glm::compMin(dims) < 2 || zBegin >= zEnd) {
+        return;
+    }
+
+    const size_t sliceSize = dims.x * dims.y;
+    const size3_t blocks = (dims - size3_t(1) + size3_t(blockSize - 1)) / blockSize;
+    const size_t blocksPerLayer = blocks.x * blocks.y;
+
+    // Slices z - 1 to z + 2 of layer z, nullptr outside of the volume
+    std::array<std::unique_ptr<T[]>, 4> scratch;
+    std::array<const T*, 4> window{};
+    const auto fetch = [&](size_t z, size_t k) -> const T* {
+        if (z >= dims.z) return nullptr;
+        if (!scratch[k]) scratch[k].reset(new T[sliceSize]);
+        return getSlice(z, scratch[k].get());
+    };
+    window[0] = zBegin > 0 ? fetch(zBegin - 1, 0) : nullptr;
+    window[1] = fetch(zBegin, 1);
+    window[2] = fetch(zBegin + 1, 2);
+
+    // Spatial positions between 0 and 1, per axis
+    std::array<std::vector<float>, 3> coords;
+    for (size_t i = 0; i < 3; ++i) {
+        coords[i].resize(dims[i]);
+        for (size_t j = 0; j < dims[i]; ++j) {
+            coords[i][j] = static_cast<float>(static_cast<double>(j) / (dims[i] - 1));
+        }
+    }
+
+    // Offsets of the four corners of a cell within a slice, corner k has x = k & 1, y = k >> 1
+    const size_t cornerOffsets[4] = {0, 1, dims.x, dims.x + 1};
+    // Voxel differences to gradients in spatial units
+    const vec3 gradientScale(dims - size3_t(1));
+
+    // Voxels are compared to the iso values in their own type
+    using Threshold = decltype(isoThreshold<T>(0.0f));
+    std::vector<Threshold> thresholds;
+    for (float iso : isos) {
+        thresholds.push_back(isoThreshold<T>(iso));
+    }
+    std::vector<unsigned> belowMasks(isos.size());
+
+    MarchingTetrahedra::Cell cell;
+    std::vector<size_t> layerBlocks;
+    for (size_t z = zBegin; z < zEnd; ++z) {
+        window[3] = fetch(z + 2, 3);
+        const T* lower = window[1];
+        const T* upper = window[2];
+        mesh.clearSlice(z + 1);
+        const size_t sliceOffset = z * sliceSize;
+
+        const size_t layer = z / blockSize;
+        layerBlocks.clear();
+        if (activeBlocks) {
+            const auto first = std::lower_bound(activeBlocks->begin(), activeBlocks->end(),
+                                                layer * blocksPerLayer);
+            const auto last =
+                std::lower_bound(first, activeBlocks->end(), (layer + 1) * blocksPerLayer);
+            layerBlocks.assign(first, last);
+        } else {
+            for (size_t block = 0; block < blocksPerLayer; ++block) {
+                layerBlocks.push_back(layer * blocksPerLayer + block);
+            }
+        }
+        for (const size_t block : layerBlocks) {
+            const size_t inLayer = block - layer * blocksPerLayer;
+            const size_t x0 = (inLayer % blocks.x) * blockSize;
+            const size_t y0 = (inLayer / blocks.x) * blockSize;
+            const size_t x1 = std::min(x0 + blockSize, dims.x - 1);
+            const size_t y1 = std::min(y0 + blockSize, dims.y - 1);
+
+            for (size_t y = y0; y < y1; ++y) {
+                for (size_t x = x0; x < x1; ++x) {
+                    const size_t i = x + y * dims.x;
+                    T values[8];
+                    bool crossed = false;
+                    {
+                        IVW_TNM067LAB2_PROFILE_SCOPE(Classification);
+                        for (size_t k = 0; k < 4; ++k) {
+                            values[k] = lower[i + cornerOffsets[k]];
+                            values[k + 4] = upper[i + cornerOffsets[k]];
+                        }
+                        for (size_t l = 0; l < thresholds.size(); ++l) {
+                            unsigned below = 0;
+                            for (size_t k = 0; k < 8; ++k) {
+                                below |= unsigned(static_cast<Threshold>(values[k]) <
+                                                  thresholds[l])
+                                         << k;
+                            }
+                            belowMasks[l] = below;
+                            crossed |= below != 0 && below != 0xFF;
+                        }
+                    }
+                    if (!crossed) {
+                        continue;
+                    }
+                    IVW_TNM067LAB2_PROFILE_COUNT(ActiveCells, 1);
+
+                    {
+                        IVW_TNM067LAB2_PROFILE_SCOPE(CellSetup);
+                        for (size_t k = 0; k < 4; ++k) {
+                            auto& v0 = cell.voxels[k];
+                            auto& v1 = cell.voxels[k + 4];
+                            v0.value = static_cast<float>(values[k]);
+                            v1.value = static_cast<float>(values[k + 4]);
+                            v0.index = sliceOffset + i + cornerOffsets[k];
+                            v1.index = v0.index + sliceSize;
+                            v0.pos = vec3(coords[0][x + (k & 1)], coords[1][y + (k >> 1)],
+                                          coords[2][z]);
+                            v1.pos = vec3(v0.pos.x, v0.pos.y, coords[2][z + 1]);
+                        }
+                    }
+
+                    // Central differences in spatial units, one-sided at the volume border
+                    const auto gradient = [&](size_t k) {
+                        const size_t vx = x + (k & 1);
+                        const size_t vy = y + ((k >> 1) & 1);
+                        const size_t w = 1 + (k >> 2);
+                        const auto value = [&](size_t wx, size_t wy, size_t ww) {
+                            return static_cast<float>(window[ww][wx + wy * dims.x]);
+                        };
+                        const size_t xl = vx > 0 ? vx - 1 : vx;
+                        const size_t xh = vx + 1 < dims.x ? vx + 1 : vx;
+                        const size_t yl = vy > 0 ? vy - 1 : vy;
+                        const size_t yh = vy + 1 < dims.y ? vy + 1 : vy;
+                        const size_t wl = window[w - 1] ? w - 1 : w;
+                        const size_t wh = window[w + 1] ? w + 1 : w;
+                        return gradientScale *
+                               vec3((value(xh, vy, w) - value(xl, vy, w)) / (xh - xl),
+                                    (value(vx, yh, w) - value(vx, yl, w)) / (yh - yl),
+                                    (value(vx, vy, wh) - value(vx, vy, wl)) / (wh - wl));
+                    };
+                    for (size_t l = 0; l < isos.size(); ++l) {
+                        if (belowMasks[l] == 0 || belowMasks[l] == 0xFF) continue;
+                        switch (method) {
+                            case MarchingTetrahedra::Method::Cubes:
+                                extractCube(mesh, cell, belowMasks[l], isos[l], l, gradient);
+                                break;
+                            case MarchingTetrahedra::Method::FiveTetrahedra:
+                                extractTetrahedra(mesh, fiveTetrahedraIds[(x + y + z) & 1], cell,
+                                                  belowMasks[l], isos[l], l, gradient);
+                                break;
+                            case MarchingTetrahedra::Method::Tetrahedra:
+                            default:
+                                extractTetrahedra(mesh, tetrahedraIds, cell, belowMasks[l],
+                                                  isos[l], l, gradient);
+                                break;
+                        }
+                    }
+                }
+            }
+        }
+        std::rotate(window.begin(), window.begin() + 1, window.end());
+        std::rotate(scratch.begin(), scratch.begin() + 1, scratch.end());
+        layerDone(z);
+    }
+}
+
+/**
+ * Calls f(i) for every i in [0, count) on at most threadCount threads, which take the next i
+ * when they are done. Rethrows an exception of f once all threads are done.
+ */
+template <typename F>
+void forEachParallel(size_t count, size_t threadCount, F f) {
+    threadCount = std::max(size_t{1}, std::min(threadCount, count));
+    std::atomic<size_t> next{0};
+    std::vector<std::exception_ptr> errors(threadCount);
+    const auto work = [&](size_t thread) {
+        try {
+            for (size_t i = next++; i < count; i = next++) {
+                f(i);
+            }
+        } catch (...) {
+            errors[thread] = std::current_exception();
+        }
+        IVW_TNM067LAB2_PROFILE_COLLECT();
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t thread = 1; thread < threadCount; ++thread) {
+        threads.emplace_back(work, thread);
+    }
+    work(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+/**
+ * Sweeps the layers of cells [first, last) of each range into a slab with all iso values, on at
+ * most threadCount threads. The edge caches of the slabs are dropped after the sweep, see
+ * MeshHelper::dropEdgeCache, so only the slabs in progress hold one. See sweepCells for the other
+ * parameters, getSlice is called concurrently.
+ */
+template <typename T, typename GetSlice>
+std::vector<MarchingTetrahedra::MeshHelper> sweepSlabs(
+    const size3_t& dims, const mat4& modelMatrix, const mat4& worldMatrix,
+    const std::vector<float>& isos, MarchingTetrahedra::Method method,
+    const std::vector<std::pair<size_t, size_t>>& ranges, size_t threadCount, size_t blockSize,
+    const std::vector<size_t>* activeBlocks, GetSlice getSlice) {
+
+    std::vector<MarchingTetrahedra::MeshHelper> slabs;
+    slabs.reserve(ranges.size());
+    for (const auto& range : ranges) {
+        slabs.emplace_back(dims, modelMatrix, worldMatrix, range.first, isos.size());
+    }
+    forEachParallel(ranges.size(), threadCount, [&](size_t slab) {
+        sweepCells<T>(slabs[slab], dims, ranges[slab].first, ranges[slab].second, isos, method,
+                      blockSize, activeBlocks, getSlice);
+        slabs[slab].dropEdgeCache();
+    });
+    return slabs;
+}
+
+/**
+ * Stitches slabs of consecutive layers of cells together bottom to top
+ */
+MarchingTetrahedra::MeshHelper stitchSlabs(
+    const size3_t& dims, const mat4& modelMatrix, const mat4& worldMatrix, size_t levelCount,
+    const std::vector<MarchingTetrahedra::MeshHelper>& slabs) {
+    MarchingTetrahedra::MeshHelper mesh(dims, modelMatrix, worldMatrix, 0, levelCount);
+    for (const auto& slab : slabs) {
+        mesh.append(slab);
+    }
+    return mesh;
+}
+
+/**
+ * Splits the layers of cells into slabCount slabs, sweeps them on separate threads and stitches
+ * the slabs together, see sweepSlabs and stitchSlabs.
+ */
+template <typename T, typename GetSlice>
+MarchingTetrahedra::MeshHelper extractSlabs(const size3_t& dims, const mat4& modelMatrix,
+                                            const mat4& worldMatrix, const std::vector<float>& isos,
+                                            MarchingTetrahedra::Method method, size_t slabCount,
+                                            size_t blockSize,
+                                            const std::vector<size_t>* activeBlocks,
+                                            GetSlice getSlice) {
+    const size_t layers = dims.z > 1 ? dims.z - 1 : 0;
+    slabCount = std::max(size_t{1}, std::min(slabCount, layers));
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t slab = 0; slab < slabCount; ++slab) {
+        ranges.emplace_back(layers * slab / slabCount, layers * (slab + 1) / slabCount);
+    }
+
+    const auto slabs = sweepSlabs<T>(dims, modelMatrix, worldMatrix, isos, method, ranges,
+                                     slabCount, blockSize, activeBlocks, getSlice);
+    return stitchSlabs(dims, modelMatrix, worldMatrix, isos.size(), slabs);
+}
+
+// Stride of the first surface of a progressive extraction, which is halved by every refinement
+constexpr size_t coarsestStride = 4;
+
+struct RefinementCancelled {};
+
+/**
+ * Extracts the surface of the voxels at every stride-th position along each axis, the voxels
+ * after the last such position are left out and the model matrix is scaled to the extent that is
+ * covered. Only the blocks in activeBlocks are visited, which have to be given for the full
+ * resolution, or all if activeBlocks is nullptr. Throws RefinementCancelled once cancelled is
+ * set, which is checked before every slice.
+ */
+MarchingTetrahedra::MeshHelper extractStrided(const Volume& volume, const VolumeRAM& ram,
+                                              const std::vector<float>& isos,
+                                              MarchingTetrahedra::Method method, size_t threads,
+                                              size_t stride,
+                                              const std::vector<size_t>* activeBlocks,
+                                              const std::atomic<bool>& cancelled) {
+    const size3_t& dims = ram.getDimensions();
+    const size3_t coarse = (glm::max(dims, size3_t(1)) - size3_t(1)) / stride + size3_t(1);
+    vec3 extent(1.0f);
+    for (int i = 0; i < 3; ++i) {
+        if (dims[i] > 1) {
+            extent[i] = static_cast<float>((coarse[i] - 1) * stride) / (dims[i] - 1);
+        }
+    }
+    const mat4 modelMatrix = glm::scale(volume.getModelMatrix(), extent);
+
+    return ram.dispatch<MarchingTetrahedra::MeshHelper, dispatching::filter::Scalars>(
+        [&](auto vrprecision) {
+            using ValueType = util::PrecisionValueType<decltype(vrprecision)>;
+            const ValueType* data = vrprecision->getDataTyped();
+            const size_t sliceSize = dims.x * dims.y;
+
+            return extractSlabs<ValueType>(
+                coarse, modelMatrix, volume.getWorldMatrix(), isos, method, threads,
+                MinMaxGrid::blockSize, activeBlocks,
+                [&](size_t z, ValueType* scratch) -> const ValueType* {
+                    if (cancelled) throw RefinementCancelled{};
+                    const ValueType* slice = data + z * stride * sliceSize;
+                    if (stride == 1) return slice;
+                    for (size_t y = 0; y < coarse.y; ++y) {
+                        for (size_t x = 0; x < coarse.x; ++x) {
+                            scratch[x + y * coarse.x] = slice[(x + y * dims.x) * stride];
+                        }
+                    }
+                    return scratch;
+                });
+        });
+}
+
+/**
+ * Sweeps the voxels of a raw file in memory into mesh and flushes the mesh to writer after every
+ * layer of cells, see MarchingTetrahedra::extractToFile. Dispatched on the format of the voxels.
+ */
+struct FileSweep {
+    template <typename Result, typename Format>
+    Result operator()(const void* voxels, const size3_t& dims, const std::vector<float>& isos,
+                      MarchingTetrahedra::Method method, MarchingTetrahedra::MeshHelper& mesh,
+                      MeshFileWriter& writer, const std::atomic<bool>& cancelled,
+                      const std::function<void(float)>& progress) {
+        using ValueType = typename Format::type;
+        const auto* data = static_cast<const ValueType*>(voxels);
+        const size_t sliceSize = dims.x * dims.y;
+        const size_t layers = dims.z > 1 ? dims.z - 1 : 0;
+
+        // The slices of the window point into the mapping and are not copied
+        sweepCells<ValueType>(
+            mesh, dims, 0, layers, isos, method, MinMaxGrid::blockSize, nullptr,
+            [&](size_t z, ValueType*) { return data + z * sliceSize; },
+            [&](size_t z) {
+                mesh.flush(writer);
+                if (progress) progress(static_cast<float>(z + 1) / layers);
+                if (cancelled) {
+                    throw Exception("Extraction cancelled",
+                                    IVW_CONTEXT_CUSTOM("MarchingTetrahedra::extractToFile"));
+                }
+            });
+    }
+};
+
+}  // namespace
 
 const ProcessorInfo MarchingTetrahedra::processorInfo_{
     "org.inviwo.MarchingTetrahedra",  // Class identifier
@@ -21,349 +603,1073 @@ const ProcessorInfo MarchingTetrahedra::getProcessorInfo() const { return proces
 MarchingTetrahedra::MarchingTetrahedra()
     : Processor()
     , volume_("volume")
+    , bricks_("bricks")
     , mesh_("mesh")
-    , isoValue_("isoValue", "ISO value", 0.5f, 0.0f, 1.0f) {
+    , isoValue_("isoValue", "ISO value", 0.5f, 0.0f, 1.0f)
+    , isoValueList_("isoValueList", "ISO value list", "")
+    , method_("method", "Method",
+              {{"tetrahedra", "Marching Tetrahedra (6 per cell)", Method::Tetrahedra},
+               {"fiveTetrahedra", "Marching Tetrahedra (5 per cell)", Method::FiveTetrahedra},
+               {"cubes", "Marching Cubes", Method::Cubes}},
+              0)
+    , threads_("threads", "Threads",
+               std::max(size_t{1}, size_t{std::thread::hardware_concurrency()}), 1, 64)
+    , vertexLayout_("vertexLayout", "Vertex Layout",
+                    {{"basic", "Position, Normal, Texcoord, Color", VertexLayout::Basic},
+                     {"compact", "Position, Octahedral Normal", VertexLayout::Compact},
+                     {"quantized", "16-bit Position, Octahedral Normal", VertexLayout::Quantized}},
+                    0)
+    , reuseBlocks_("reuseBlocks", "Re-extract changed blocks only", false)
+    , progressive_("progressive", "Progressive preview", false)
+    , roi_("roi", "Region of interest")
+    , roiX_("roiX", "X", 0.0f, 1.0f, 0.0f, 1.0f)
+    , roiY_("roiY", "Y", 0.0f, 1.0f, 0.0f, 1.0f)
+    , roiZ_("roiZ", "Z", 0.0f, 1.0f, 0.0f, 1.0f)
+    , outOfCore_("outOfCore", "Out-of-core extraction")
+    , outOfCoreVolume_("outOfCoreVolume", "Volume (.dat)")
+    , outOfCoreMesh_("outOfCoreMesh", "Mesh file")
+    , outOfCoreExtract_("outOfCoreExtract", "Extract to file")
+#ifdef IVW_TNM067LAB2_PROFILING
+    , profile_("profile", "Profile")
+#endif
+{
 
+    volume_.setOptional(true);
+    bricks_.setOptional(true);
     addPort(volume_);
+    addPort(bricks_);
     addPort(mesh_);
 
     addProperty(isoValue_);
+    addProperty(isoValueList_);
+    addProperty(method_);
+    addProperty(threads_);
+    addProperty(vertexLayout_);
+    addProperty(reuseBlocks_);
+    addProperty(progressive_);
+    roi_.addProperty(roiX_);
+    roi_.addProperty(roiY_);
+    roi_.addProperty(roiZ_);
+    roi_.setCollapsed(true);
+    addProperty(roi_);
+    outOfCoreVolume_.addNameFilter("Volume description (*.dat)");
+    outOfCore_.addProperty(outOfCoreVolume_);
+    outOfCore_.addProperty(outOfCoreMesh_);
+    outOfCore_.addProperty(outOfCoreExtract_);
+    outOfCore_.setCollapsed(true);
+    addProperty(outOfCore_);
+#ifdef IVW_TNM067LAB2_PROFILING
+    for (const auto& stage : ExtractionProfile::stages) {
+        auto& time = stageTimes_.emplace_back(std::make_unique<DoubleProperty>(
+            stage.identifier, std::string(stage.name) + " (ms)", 0.0, 0.0,
+            std::numeric_limits<double>::max(), 0.01, InvalidationLevel::Valid));
+        time->setReadOnly(true);
+        time->setSerializationMode(PropertySerializationMode::None);
+        profile_.addProperty(*time);
+    }
+    for (const auto& counter : ExtractionProfile::counters) {
+        auto& count = counts_.emplace_back(std::make_unique<IntSizeTProperty>(
+            counter.identifier, counter.name, 0, 0, std::numeric_limits<size_t>::max(), 1,
+            InvalidationLevel::Valid));
+        count->setReadOnly(true);
+        count->setSerializationMode(PropertySerializationMode::None);
+        profile_.addProperty(*count);
+    }
+    profile_.setCollapsed(true);
+    addProperty(profile_);
+#endif
 
     isoValue_.setSerializationMode(PropertySerializationMode::All);
 
     volume_.onChange([&]() {
+        volumeChanged_ = true;
         if (!volume_.hasData()) {
             return;
         }
-        NetworkLock lock(getNetwork());
-        float iso = (isoValue_.get() - isoValue_.getMinValue()) /
-                    (isoValue_.getMaxValue() - isoValue_.getMinValue());
-        const auto vr = volume_.getData()->dataMap_.valueRange;
-        isoValue_.setMinValue(static_cast<float>(vr.x));
-        isoValue_.setMaxValue(static_cast<float>(vr.y));
-        isoValue_.setIncrement(static_cast<float>(glm::abs(vr.y - vr.x) / 50.0));
-        isoValue_.set(static_cast<float>(iso * (vr.y - vr.x) + vr.x));
-        isoValue_.setCurrentStateAsDefault();
+        updateIsoValueRange(volume_.getData()->dataMap_.valueRange);
+    });
+    outOfCoreExtract_.onChange([&]() {
+        if (fileExtraction_) {
+            fileExtraction_->cancelled = true;
+        } else {
+            startFileExtraction();
+        }
+    });
+    bricks_.onChange([&]() {
+        if (!bricks_.hasData()) {
+            return;
+        }
+        updateIsoValueRange(bricks_.getData()->getValueRange());
     });
 }
 
+MarchingTetrahedra::~MarchingTetrahedra() {
+    cancelRefinement();
+    if (fileExtraction_) {
+        fileExtraction_->cancelled = true;
+        fileExtraction_->destroyed = true;
+    }
+}
+
+void MarchingTetrahedra::updateIsoValueRange(dvec2 vr) {
+    NetworkLock lock(getNetwork());
+    float iso = (isoValue_.get() - isoValue_.getMinValue()) /
+                (isoValue_.getMaxValue() - isoValue_.getMinValue());
+    isoValue_.setMinValue(static_cast<float>(vr.x));
+    isoValue_.setMaxValue(static_cast<float>(vr.y));
+    isoValue_.setIncrement(static_cast<float>(glm::abs(vr.y - vr.x) / 50.0));
+    isoValue_.set(static_cast<float>(iso * (vr.y - vr.x) + vr.x));
+    isoValue_.setCurrentStateAsDefault();
+}
+
 void MarchingTetrahedra::process() {
-    auto volume = volume_.getData()->getRepresentation<VolumeRAM>();
-    MeshHelper mesh(volume_.getData());
+    extract();
+#ifdef IVW_TNM067LAB2_PROFILING
+    showProfile();
+#endif
+}
+
+#ifdef IVW_TNM067LAB2_PROFILING
+void MarchingTetrahedra::showProfile() {
+    IVW_TNM067LAB2_PROFILE_COLLECT();
+    const auto profile = ExtractionProfile::takeTotal();
+    for (size_t i = 0; i < ExtractionProfile::stageCount; ++i) {
+        stageTimes_[i]->set(profile.milliseconds(static_cast<ExtractionProfile::Stage>(i)));
+    }
+    for (size_t i = 0; i < ExtractionProfile::counterCount; ++i) {
+        counts_[i]->set(static_cast<size_t>(profile.counts[i]));
+    }
+    LogInfo("Extraction profile:" << profile.summary());
+}
+#endif
+
+void MarchingTetrahedra::extract() {
+    if (bricks_.hasData()) {
+        cancelRefinement();
+        processBricks(*bricks_.getData());
+        return;
+    }
+    if (!volume_.hasData()) {
+        cancelRefinement();
+        mesh_.clear();
+        return;
+    }
 
+    auto volume = volume_.getData()->getRepresentation<VolumeRAM>();
     const auto& dims = volume->getDimensions();
-    MarchingTetrahedra::HashFunc::max = dims.x * dims.y * dims.z;
-
-    const float iso = isoValue_.get();
-
-    util::IndexMapper3D index(dims);
-
-    const static size_t tetrahedraIds[6][4] = {{0, 1, 2, 5}, {1, 3, 2, 5}, {3, 2, 5, 7},
-                                               {0, 2, 4, 5}, {6, 4, 2, 5}, {6, 7, 5, 2}};
-
-    size3_t pos{};
-    for (pos.z = 0; pos.z < dims.z - 1; ++pos.z) {
-        for (pos.y = 0; pos.y < dims.y - 1; ++pos.y) {
-            for (pos.x = 0; pos.x < dims.x - 1; ++pos.x) {
-                // Step 1: create current cell
-                // Use volume->getAsDouble to query values from the volume
-                // Spatial position should be between 0 and 1
-                // The voxel index should be the 1D-index for the voxel
-                double dimx = dims.x - 1;
-                double dimy = dims.y - 1;
-                double dimz = dims.z - 1;
-
-                Voxel v0, v1, v2, v3, v4, v5, v6, v7;
-                vec3 spatpos0, spatpos1, spatpos2, spatpos3, spatpos4, spatpos5, spatpos6, spatpos7;
-
-                spatpos0 = vec3{pos.x / dimx, pos.y / dimy, pos.z / dimz};
-                spatpos1 = vec3{(pos.x + 1) / dimx, pos.y / dimy, pos.z / dimz};
-                spatpos2 = vec3{pos.x / dimx, (pos.y + 1) / dimy, pos.z / dimz};
-                spatpos3 = vec3{(pos.x + 1) / dimy, (pos.y + 1) / dimy, pos.z / dimz};
-                spatpos4 = vec3{pos.x / dimx, pos.y / dimy, (pos.z + 1) / dimz};
-                spatpos5 = vec3{(pos.x + 1) / dimx, (pos.y) / dimy, (pos.z + 1) / dimz};
-                spatpos6 = vec3{pos.x / dimx, (pos.y + 1) / dimy, (pos.z + 1) / dimz};
-                spatpos7 = vec3{(pos.x + 1) / dimx, (pos.y + 1) / dimy, (pos.z + 1) / dimz};
-
-                v0.pos = vec3{pos.x, pos.y, pos.z};
-                v1.pos = vec3{(pos.x + 1), pos.y, pos.z};
-                v2.pos = vec3{pos.x, (pos.y+1), pos.z};
-                v3.pos = vec3{(pos.x+1), (pos.y + 1), pos.z};
-                v4.pos = vec3{pos.x, pos.y, (pos.z+1)};
-                v5.pos = vec3{(pos.x+1), (pos.y), (pos.z+1)};
-                v6.pos = vec3{pos.x, (pos.y + 1), (pos.z+1)};
-                v7.pos = vec3{(pos.x+1), (pos.y + 1), (pos.z+1)};
-
-                v0.value = volume->getAsDouble(v0.pos);
-                v1.value = volume->getAsDouble(v1.pos);
-                v2.value = volume->getAsDouble(v2.pos);
-                v3.value = volume->getAsDouble(v3.pos);
-                v4.value = volume->getAsDouble(v4.pos);
-                v5.value = volume->getAsDouble(v5.pos);
-                v6.value = volume->getAsDouble(v6.pos);
-                v7.value = volume->getAsDouble(v7.pos);        
-
-                v0.index = index(v0.pos);
-                v1.index = index(v1.pos);
-                v2.index = index(v2.pos);
-                v3.index = index(v3.pos);
-                v4.index = index(v4.pos);
-                v5.index = index(v5.pos);
-                v6.index = index(v6.pos);
-                v7.index = index(v7.pos);
-
-                v0.pos = spatpos0;
-                v1.pos = spatpos1;
-                v2.pos = spatpos2;
-                v3.pos = spatpos3;
-                v4.pos = spatpos4;
-                v5.pos = spatpos5;
-                v6.pos = spatpos6;
-                v7.pos = spatpos7;
-                
-                Cell c;
-                c.voxels[0] = v0;
-                c.voxels[1] = v1;
-                c.voxels[2] = v2;
-                c.voxels[3] = v3;
-                c.voxels[4] = v4;
-                c.voxels[5] = v5;
-                c.voxels[6] = v6;
-                c.voxels[7] = v7;
-
-                // Step 2: Subdivide cell into tetrahedra (hint: use tetrahedraIds)
-                Tetrahedra t0 = Tetrahedra{c.voxels[0], c.voxels[1], c.voxels[2], c.voxels[5]};
-                Tetrahedra t1 = Tetrahedra{c.voxels[1], c.voxels[3], c.voxels[2], c.voxels[5]};
-                Tetrahedra t2 = Tetrahedra{c.voxels[3], c.voxels[2], c.voxels[5], c.voxels[7]};
-                Tetrahedra t3 = Tetrahedra{c.voxels[0], c.voxels[2], c.voxels[4], c.voxels[5]};
-                Tetrahedra t4 = Tetrahedra{c.voxels[6], c.voxels[4], c.voxels[2], c.voxels[5]};
-                Tetrahedra t5 = Tetrahedra{c.voxels[6], c.voxels[7], c.voxels[5], c.voxels[2]};
-
-                std::vector<Tetrahedra> tetrahedras;
-                Tetrahedra tetra;
-                for (int i = 0; i < 6; i++) {
-                    for (int j = 0; j < 4; j++) {
-                        tetra.voxels[j] = c.voxels[tetrahedraIds[i][j]];
+
+    // The iso values are given in value space while the voxels are stored in data space, e.g.
+    // for volumes with normalized integer formats
+    auto isos = getIsoValues();
+    for (auto& iso : isos) {
+        iso = static_cast<float>(
+            volume_.getData()->dataMap_.mapFromValueToData(static_cast<double>(iso)));
+    }
+
+    // Only the blocks of cells whose range includes one of the iso values are visited
+    std::vector<size_t> changedBlocks;
+    const bool volumeChanged = volumeChanged_;
+    if (!minMaxGrid_ || minMaxGrid_->tracksChanges() != reuseBlocks_.get()) {
+        minMaxGrid_ = std::make_unique<MinMaxGrid>(*volume, reuseBlocks_.get(), threads_.get());
+        blockCache_ = BlockCache{};
+    } else if (volumeChanged_) {
+        changedBlocks = minMaxGrid_->update(*volume, threads_.get());
+    }
+    volumeChanged_ = false;
+    std::vector<size_t> activeBlocks;
+    for (float iso : isos) {
+        const auto blocks = minMaxGrid_->getActiveBlocks(iso);
+        std::vector<size_t> merged;
+        merged.reserve(activeBlocks.size() + blocks.size());
+        std::set_union(activeBlocks.begin(), activeBlocks.end(), blocks.begin(), blocks.end(),
+                       std::back_inserter(merged));
+        activeBlocks.swap(merged);
+    }
+
+    // The voxels of the region of interest, the voxels of a cell cut by the region are included
+    const vec2 roi[3] = {roiX_.get(), roiY_.get(), roiZ_.get()};
+    size3_t first{0};
+    size3_t last = glm::max(dims, size3_t(1)) - size3_t(1);
+    for (int i = 0; i < 3; ++i) {
+        const float extent = static_cast<float>(last[i]);
+        first[i] = static_cast<size_t>(glm::clamp(std::floor(roi[i].x * extent), 0.0f, extent));
+        last[i] = static_cast<size_t>(
+            glm::clamp(std::ceil(roi[i].y * extent), static_cast<float>(first[i]), extent));
+    }
+    if (first != size3_t(0) || last + size3_t(1) != dims) {
+        cancelRefinement();
+        blockCache_ = BlockCache{};
+        processRegion(*volume, isos, activeBlocks, first, last);
+        return;
+    }
+
+    if (progressive_.get()) {
+        blockCache_ = BlockCache{};
+        processProgressive(isos, activeBlocks, volumeChanged);
+        return;
+    }
+    cancelRefinement();
+    if (reuseBlocks_.get()) {
+        processIncremental(*volume, isos, activeBlocks, changedBlocks);
+        return;
+    }
+    blockCache_ = BlockCache{};
+
+    volume->dispatch<void, dispatching::filter::Scalars>([&](auto vrprecision) {
+        using ValueType = util::PrecisionValueType<decltype(vrprecision)>;
+        const ValueType* data = vrprecision->getDataTyped();
+        const size_t sliceSize = dims.x * dims.y;
+
+        auto mesh = extractSlabs<ValueType>(
+            dims, volume_.getData()->getModelMatrix(), volume_.getData()->getWorldMatrix(), isos,
+            method_.get(), threads_.get(), MinMaxGrid::blockSize, &activeBlocks,
+            [&](size_t z, ValueType*) { return data + z * sliceSize; });
+        mesh_.setData(createMesh(mesh));
+    });
+}
+
+void MarchingTetrahedra::processIncremental(const VolumeRAM& volume,
+                                            const std::vector<float>& isos,
+                                            const std::vector<size_t>& activeBlocks,
+                                            const std::vector<size_t>& changedBlocks) {
+    const auto& dims = volume.getDimensions();
+    const size_t blockSize = MinMaxGrid::blockSize;
+    const size3_t& blocks = minMaxGrid_->getDimensions();
+    const size_t blockCount = blocks.x * blocks.y * blocks.z;
+    const size_t layers = dims.z > 1 ? dims.z - 1 : 0;
+
+    std::vector<char> dirty(blockCount, 0);
+    if (blockCache_.dims != dims || blockCache_.isos != isos ||
+        blockCache_.method != method_.get() || blockCache_.format != volume.getDataFormat()) {
+        blockCache_.isos = isos;
+        blockCache_.method = method_.get();
+        blockCache_.format = volume.getDataFormat();
+        blockCache_.dims = dims;
+        blockCache_.surface = BlockSurface(isos.size());
+        std::fill(dirty.begin(), dirty.end(), 1);
+    } else {
+        // The gradients at the voxels of a block reach one voxel into the blocks around it
+        for (const size_t block : changedBlocks) {
+            const size3_t center(block % blocks.x, (block / blocks.x) % blocks.y,
+                                 block / (blocks.x * blocks.y));
+            const size3_t first = glm::max(center, size3_t(1)) - size3_t(1);
+            const size3_t last = glm::min(center + size3_t(1), blocks - size3_t(1));
+            for (size_t z = first.z; z <= last.z; ++z) {
+                for (size_t y = first.y; y <= last.y; ++y) {
+                    for (size_t x = first.x; x <= last.x; ++x) {
+                        dirty[x + blocks.x * (y + blocks.y * z)] = 1;
                     }
-                    tetrahedras.push_back(tetra);
                 }
-                for (const Tetrahedra& tetrahedra : tetrahedras) {
-                    // Step three: Calculate for tetra case index
-                    
-                    int caseId = 0;
-                    for (int i = 0; i < 4; i++) {
-                        if (tetrahedra.voxels[i].value < iso) {
-                            caseId += 1 * pow(2, 3 - i);
-                        }
-                    }
+            }
+        }
+    }
+    std::vector<size_t> dirtyBlocks;
+    for (size_t block = 0; block < blockCount; ++block) {
+        if (dirty[block]) dirtyBlocks.push_back(block);
+    }
+    std::vector<size_t> extracted;
+    for (const size_t block : activeBlocks) {
+        if (dirty[block]) extracted.push_back(block);
+    }
+
+    auto& surface = blockCache_.surface;
+    std::vector<MeshHelper> pieces;
+    pieces.reserve(extracted.size());
+    for (const size_t block : extracted) {
+        pieces.push_back(surface.makePiece(dims, block));
+    }
+    volume.dispatch<void, dispatching::filter::Scalars>([&](auto vrprecision) {
+        using ValueType = util::PrecisionValueType<decltype(vrprecision)>;
+        const ValueType* data = vrprecision->getDataTyped();
+        const size_t sliceSize = dims.x * dims.y;
 
+        forEachParallel(pieces.size(), threads_.get(), [&](size_t piece) {
+            const std::vector<size_t> block{extracted[piece]};
+            const size_t z = block.front() / (blocks.x * blocks.y) * blockSize;
+            sweepCells<ValueType>(pieces[piece], dims, z, std::min(z + blockSize, layers), isos,
+                                  method_.get(), blockSize, &block,
+                                  [&](size_t sz, ValueType*) { return data + sz * sliceSize; });
+            pieces[piece].dropEdgeCache();
+        });
+    });
 
-                    vec3 interpValPos0, interpValPos1, interpValPos2, interpValPos3;
-
-                    vec3 pos0 = tetrahedra.voxels[0].pos;
-                    vec3 pos1 = tetrahedra.voxels[1].pos;
-                    vec3 pos2 = tetrahedra.voxels[2].pos;
-                    vec3 pos3 = tetrahedra.voxels[3].pos;
-                    double val0 = tetrahedra.voxels[0].value;
-                    double val1 = tetrahedra.voxels[1].value;
-                    double val2 = tetrahedra.voxels[2].value;
-                    double val3 = tetrahedra.voxels[3].value;
-                    size_t idx0 = tetrahedra.voxels[0].index;
-                    size_t idx1 = tetrahedra.voxels[1].index;
-                    size_t idx2 = tetrahedra.voxels[2].index;
-                    size_t idx3 = tetrahedra.voxels[3].index;
-
-                    // step four: Extract triangles
-                    if (caseId == 0 || caseId == 15) {
-                        //no triangles added
-                    }
+    // In the order of the blocks, so the result does not depend on the number of threads
+    surface.remove(dirtyBlocks);
+    for (size_t piece = 0; piece < pieces.size(); ++piece) {
+        surface.add(extracted[piece], pieces[piece]);
+    }
+    pieces.clear();
 
-                    if (caseId == 1 || caseId == 14) {
-                        interpValPos0 = pos0 + (pos1 - pos0) * (iso - val0) / (val1 - val0);
-                        interpValPos1 = pos0 + (pos3 - pos0) * (iso - val0) / (val3 - val0);
-                        interpValPos2 = pos0 + (pos2 - pos0) * (iso - val0) / (val2 - val0);
-
-                        std::uint32_t id0 = mesh.addVertex(interpValPos0, idx0, idx1);
-                        std::uint32_t id1 = mesh.addVertex(interpValPos1, idx0, idx3);
-                        std::uint32_t id2 = mesh.addVertex(interpValPos2, idx0, idx2);
-                        
-                        if (caseId == 1) {
-                            mesh.addTriangle(id0, id1, id2);
-                        } else {
-                            mesh.addTriangle(id0, id2, id1);
-                        }
-                    }
-                    
-                    if (caseId == 2 || caseId == 13) {
-                        interpValPos0 = pos1 + (pos3 - pos1) * (iso - val1) / (val3 - val1);
-                        interpValPos1 = pos1 + (pos2 - pos1) * (iso - val1) / (val2 - val1);
-                        interpValPos2 = pos1 + (pos0 - pos1) * (iso - val1) / (val0 - val1);
-
-                        std::uint32_t id0 = mesh.addVertex(interpValPos0, idx1, idx3);
-                        std::uint32_t id1 = mesh.addVertex(interpValPos1, idx1, idx2);
-                        std::uint32_t id2 = mesh.addVertex(interpValPos2, idx1, idx0);
-
-                        if (caseId == 2) {
-                            mesh.addTriangle(id0, id1, id2);
-                        } else {
-                            mesh.addTriangle(id0, id2, id1);
+    auto mesh = surface.toMeshHelper(dims, volume_.getData()->getModelMatrix(),
+                                     volume_.getData()->getWorldMatrix());
+    mesh_.setData(createMesh(mesh));
+}
+
+void MarchingTetrahedra::processRegion(const VolumeRAM& volume, const std::vector<float>& isos,
+                                       const std::vector<size_t>& activeBlocks,
+                                       const size3_t& first, const size3_t& last) {
+    const auto& dims = volume.getDimensions();
+    const size3_t regionDims = last - first + size3_t(1);
+    if (glm::compMin(regionDims) < 2) {
+        mesh_.clear();
+        return;
+    }
+    const size_t blockSize = MinMaxGrid::blockSize;
+
+    // The blocks of the region are not aligned with the blocks of the grid, a block of the region
+    // is active if any block of the grid that shares cells with it is
+    const size3_t& blocks = minMaxGrid_->getDimensions();
+    util::IndexMapper3D blockIndex(blocks);
+    std::vector<char> active(blocks.x * blocks.y * blocks.z, 0);
+    for (const size_t block : activeBlocks) {
+        active[block] = 1;
+    }
+    const size3_t regionBlocks = (regionDims - size3_t(1) + size3_t(blockSize - 1)) / blockSize;
+    std::vector<size_t> regionActive;
+    size3_t block{};
+    for (block.z = 0; block.z < regionBlocks.z; ++block.z) {
+        for (block.y = 0; block.y < regionBlocks.y; ++block.y) {
+            for (block.x = 0; block.x < regionBlocks.x; ++block.x) {
+                // Cells [begin, end) of the volume
+                const size3_t begin = first + block * blockSize;
+                const size3_t end = glm::min(begin + size3_t(blockSize), last);
+                const size3_t lower = glm::min(begin / blockSize, blocks - size3_t(1));
+                const size3_t upper = glm::min((end - size3_t(1)) / blockSize, blocks - size3_t(1));
+                bool overlaps = false;
+                for (size_t z = lower.z; z <= upper.z && !overlaps; ++z) {
+                    for (size_t y = lower.y; y <= upper.y && !overlaps; ++y) {
+                        for (size_t x = lower.x; x <= upper.x && !overlaps; ++x) {
+                            overlaps = active[blockIndex(size3_t(x, y, z))] != 0;
                         }
                     }
-                    
-                    
-                    if (caseId == 3 || caseId == 12) {
-                        interpValPos0 = pos1 + (pos2 - pos1) * (iso - val1) / (val2 - val1);
-                        interpValPos1 = pos1 + (pos3 - pos1) * (iso - val1) / (val3 - val1);
-                        interpValPos2 = pos0 + (pos3 - pos0) * (iso - val0) / (val3 - val0);
-                        interpValPos3 = pos0 + (pos2 - pos0) * (iso - val0) / (val2 - val0);
-
-                        std::uint32_t id0 = mesh.addVertex(interpValPos0, idx1, idx2);
-                        std::uint32_t id1 = mesh.addVertex(interpValPos1, idx1, idx3);
-                        std::uint32_t id2 = mesh.addVertex(interpValPos2, idx0, idx3);
-                        std::uint32_t id3 = mesh.addVertex(interpValPos3, idx0, idx2);
-
-                        if (caseId == 3) {
-                            mesh.addTriangle(id0, id1, id2);
-                            mesh.addTriangle(id0, id2, id3);
-                        } else {
-                            mesh.addTriangle(id2, id1, id0);
-                            mesh.addTriangle(id3, id2, id0);
-                        }
+                }
+                if (overlaps) {
+                    regionActive.push_back(
+                        block.x + regionBlocks.x * (block.y + regionBlocks.y * block.z));
+                }
+            }
+        }
+    }
 
-                    }
-                    
+    // Maps the unit cube of the region into the unit cube of the volume
+    vec3 offset(0.0f);
+    vec3 extent(1.0f);
+    for (int i = 0; i < 3; ++i) {
+        if (dims[i] > 1) {
+            offset[i] = static_cast<float>(first[i]) / (dims[i] - 1);
+            extent[i] = static_cast<float>(last[i] - first[i]) / (dims[i] - 1);
+        }
+    }
+    const mat4 modelMatrix =
+        glm::scale(glm::translate(volume_.getData()->getModelMatrix(), offset), extent);
 
-                    if (caseId == 4 || caseId == 11) {
-                        interpValPos0 = pos2 + (pos0 - pos2) * (iso - val2) / (val0 - val2);
-                        interpValPos1 = pos2 + (pos1 - pos2) * (iso - val2) / (val1 - val2);
-                        interpValPos2 = pos2 + (pos3 - pos2) * (iso - val2) / (val3 - val2);
+    volume.dispatch<void, dispatching::filter::Scalars>([&](auto vrprecision) {
+        using ValueType = util::PrecisionValueType<decltype(vrprecision)>;
+        const ValueType* data = vrprecision->getDataTyped();
+        const size_t sliceSize = dims.x * dims.y;
 
-                        std::uint32_t id0 = mesh.addVertex(interpValPos0, idx2, idx0);
-                        std::uint32_t id1 = mesh.addVertex(interpValPos1, idx2, idx1);
-                        std::uint32_t id2 = mesh.addVertex(interpValPos2, idx2, idx3);
+        auto mesh = extractSlabs<ValueType>(
+            regionDims, modelMatrix, volume_.getData()->getWorldMatrix(), isos, method_.get(),
+            threads_.get(), blockSize, &regionActive, [&](size_t z, ValueType* scratch) {
+                const ValueType* slice = data + (first.z + z) * sliceSize + first.x;
+                for (size_t y = 0; y < regionDims.y; ++y) {
+                    const ValueType* row = slice + (first.y + y) * dims.x;
+                    std::copy(row, row + regionDims.x, scratch + y * regionDims.x);
+                }
+                return scratch;
+            });
+        mesh_.setData(createMesh(mesh));
+    });
+}
 
-                        if (caseId == 4) {
-                            mesh.addTriangle(id0, id1, id2);
-                        } else {
-                            mesh.addTriangle(id0, id2, id1);
-                        }
-                    }
-                    
-
-                    if (caseId == 5 || caseId == 10) {
-                        
-                        interpValPos0 = pos0 + (pos3 - pos0) * (iso - val0) / (val3 - val0);
-                        interpValPos1 = pos0 + (pos1 - pos0) * (iso - val0) / (val1 - val0);
-                        interpValPos2 = pos2 + (pos1 - pos2) * (iso - val2) / (val1 - val2);
-                        interpValPos3 = pos2 + (pos3 - pos2) * (iso - val2) / (val3 - val2);
-
-                        std::uint32_t id0 = mesh.addVertex(interpValPos0, idx0, idx3);
-                        std::uint32_t id1 = mesh.addVertex(interpValPos1, idx0, idx1);
-                        std::uint32_t id2 = mesh.addVertex(interpValPos2, idx2, idx1);
-                        std::uint32_t id3 = mesh.addVertex(interpValPos3, idx2, idx3);
-
-                        if (caseId == 5) {
-                            mesh.addTriangle(id0, id1, id2);
-                            mesh.addTriangle(id0, id2, id3);
-                        } else {
-                            mesh.addTriangle(id2, id1, id0);
-                            mesh.addTriangle(id3, id2, id0);
-                        }
-                        
-                    }
+void MarchingTetrahedra::processProgressive(const std::vector<float>& isos,
+                                            const std::vector<size_t>& activeBlocks,
+                                            bool volumeChanged) {
+    const auto volume = volume_.getData();
+    const bool sameSurface = refinement_ && !volumeChanged && refinement_->volume == volume &&
+                             refinement_->isos == isos && refinement_->method == method_.get();
 
-                    if (caseId == 6 || caseId == 9) {
-                        interpValPos0 = pos0 + (pos2 - pos0) * (iso - val0) / (val2 - val0);
-                        interpValPos1 = pos0 + (pos1 - pos0) * (iso - val0) / (val1 - val0);
-                        interpValPos2 = pos1 + (pos3 - pos1) * (iso - val1) / (val3 - val1);
-                        interpValPos3 = pos2 + (pos3 - pos2) * (iso - val2) / (val3 - val2);
-
-                        std::uint32_t id0 = mesh.addVertex(interpValPos0, idx0, idx2);
-                        std::uint32_t id1 = mesh.addVertex(interpValPos1, idx0, idx1);
-                        std::uint32_t id2 = mesh.addVertex(interpValPos2, idx2, idx3);
-                        std::uint32_t id3 = mesh.addVertex(interpValPos3, idx2, idx3);
-
-                        if (caseId == 9) {
-                            mesh.addTriangle(id0, id1, id2);
-                            mesh.addTriangle(id0, id2, id3);
-                        } else {
-                            mesh.addTriangle(id0, id2, id1);
-                            mesh.addTriangle(id0, id3, id2);
-                        }
-                        
-                    }
+    if (sameSurface && refinement_->result.valid()) {
+        // Other changes, e.g. of the vertex layout, are picked up when the refinement is done
+        if (refinement_->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+        auto mesh = refinement_->result.get();
+        if (refinement_->stride == 1) {
+            // createMesh consumes the helper, so a copy is kept for later calls
+            mesh.dropEdgeCache();
+            refinement_->surface = std::make_unique<MeshHelper>(mesh);
+        }
+        mesh_.setData(createMesh(mesh));
+        if (refinement_->stride > 1) {
+            startRefinement(isos, activeBlocks, refinement_->stride / 2);
+        }
+        return;
+    }
+
+    if (sameSurface && refinement_->surface) {
+        // The surface is fully refined, only the mesh has to be created again
+        auto mesh = *refinement_->surface;
+        mesh_.setData(createMesh(mesh));
+        return;
+    }
+
+    cancelRefinement();
+    const auto ram = volume->getRepresentation<VolumeRAM>();
+    const std::atomic<bool> notCancelled{false};
+    auto mesh = extractStrided(*volume, *ram, isos, method_.get(), threads_.get(),
+                               coarsestStride, nullptr, notCancelled);
+    mesh_.setData(createMesh(mesh));
+    startRefinement(isos, activeBlocks, coarsestStride / 2);
+}
+
+void MarchingTetrahedra::startRefinement(const std::vector<float>& isos,
+                                         const std::vector<size_t>& activeBlocks, size_t stride) {
+    auto refinement = std::make_shared<Refinement>();
+    refinement->volume = volume_.getData();
+    refinement->isos = isos;
+    refinement->method = method_.get();
+    refinement->stride = stride;
+    auto promise = std::make_shared<std::promise<MeshHelper>>();
+    refinement->result = promise->get_future();
+    refinement_ = refinement;
+
+    // The representation is fetched here, the task only reads it
+    const VolumeRAM* ram = refinement->volume->getRepresentation<VolumeRAM>();
+    // The active blocks are given for the full resolution
+    auto blocks = stride == 1 ? std::make_shared<std::vector<size_t>>(activeBlocks) : nullptr;
+
+    dispatchPool([this, refinement, promise, ram, blocks]() {
+        try {
+            // A single slab, the task already occupies a thread of the pool and more threads
+            // would compete with the other tasks
+            promise->set_value(extractStrided(*refinement->volume, *ram, refinement->isos,
+                                              refinement->method, 1, refinement->stride,
+                                              blocks.get(), refinement->cancelled));
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+        // The processor is only touched on the front thread, where it is cancelled on
+        // destruction
+        dispatchFront([this, refinement]() {
+            if (!refinement->cancelled) invalidate(InvalidationLevel::InvalidOutput);
+        });
+    });
+}
+
+void MarchingTetrahedra::cancelRefinement() {
+    if (refinement_) {
+        refinement_->cancelled = true;
+        refinement_.reset();
+    }
+}
+
+void MarchingTetrahedra::startFileExtraction() {
+    std::vector<float> isos;
+    try {
+        isos = getIsoValues();
+    } catch (const Exception& e) {
+        LogError(e.getMessage());
+        return;
+    }
+    auto extraction = std::make_shared<FileExtraction>();
+    fileExtraction_ = extraction;
+    outOfCoreExtract_.setDisplayName("Cancel extraction");
+    getProgressBar().resetProgress();
+    getProgressBar().show();
+
+    const std::string datFile = outOfCoreVolume_.get();
+    const std::string meshFile = outOfCoreMesh_.get();
+    const Method method = method_.get();
+    dispatchPool([this, extraction, datFile, meshFile, method, isos]() {
+        // The progress is passed on in steps of a percent, not for every layer
+        int percent = 0;
+        const auto progress = [&](float fraction) {
+            const int step = static_cast<int>(fraction * 100.0f);
+            if (step == percent) return;
+            percent = step;
+            dispatchFront([this, extraction, fraction]() {
+                if (!extraction->destroyed) updateProgress(fraction);
+            });
+        };
+        std::uint64_t triangles = 0;
+        std::string error;
+        try {
+            triangles =
+                extractToFile(datFile, isos, method, meshFile, extraction->cancelled, progress);
+        } catch (const Exception& e) {
+            error = e.getMessage();
+        } catch (const std::exception& e) {
+            error = e.what();
+        }
+        // The processor is only touched on the front thread, where it is marked on destruction
+        dispatchFront([this, extraction, meshFile, triangles, error]() {
+            if (extraction->destroyed) return;
+            finishFileExtraction();
+            if (extraction->cancelled) {
+                LogInfo("Cancelled the extraction to " << meshFile);
+            } else if (!error.empty()) {
+                LogError(error);
+            } else {
+                LogInfo("Wrote " << triangles << " triangles to " << meshFile);
+            }
+        });
+    });
+}
 
-                    if (caseId == 7 || caseId == 8) {
-                        
-                        interpValPos0 = pos3 + (pos0 - pos3) * (iso - val3) / (val0 - val3);
-                        interpValPos1 = pos3 + (pos1 - pos3) * (iso - val3) / (val1 - val3);
-                        interpValPos2 = pos3 + (pos2 - pos3) * (iso - val3) / (val2 - val3);
+void MarchingTetrahedra::finishFileExtraction() {
+    fileExtraction_.reset();
+    outOfCoreExtract_.setDisplayName("Extract to file");
+    getProgressBar().hide();
+}
+
+void MarchingTetrahedra::processBricks(const BrickedVolume& bricks) {
+    const auto& dims = bricks.getDimensions();
+    if (glm::compMin(dims) < 2) {
+        mesh_.clear();
+        return;
+    }
 
-                        std::uint32_t id0 = mesh.addVertex(interpValPos0, idx3, idx0);
-                        std::uint32_t id1 = mesh.addVertex(interpValPos1, idx3, idx1);
-                        std::uint32_t id2 = mesh.addVertex(interpValPos2, idx3, idx2);
+    const auto isos = getIsoValues();
+    const size_t brickSize = BrickedVolume::brickSize;
+    const auto& counts = bricks.getBrickCounts();
+    util::IndexMapper3D brickIndex(counts);
 
-                        if (caseId == 8) {
-                            mesh.addTriangle(id0, id1, id2);
-                        } else {
-                            mesh.addTriangle(id0, id2, id1);
+    // A block of cells is active if its bound includes one of the iso values. The cells with their
+    // lowest corner in a brick and the gradients at their voxels reach into the neighboring
+    // bricks, so the voxels of a brick are needed if the brick or any of its neighbors is active.
+    const size3_t blocks = (dims - size3_t(1) + size3_t(brickSize - 1)) / brickSize;
+    std::vector<size3_t> activeBricks;
+    std::vector<char> needed(counts.x * counts.y * counts.z, 0);
+    size3_t lowest = counts;
+    size3_t highest{0};
+    size3_t brick{};
+    for (brick.z = 0; brick.z < blocks.z; ++brick.z) {
+        for (brick.y = 0; brick.y < blocks.y; ++brick.y) {
+            for (brick.x = 0; brick.x < blocks.x; ++brick.x) {
+                const size3_t first = brick * brickSize;
+                const size3_t last = glm::min(first + size3_t(brickSize), dims - size3_t(1));
+                const dvec2 bound = bricks.getBound(first, last);
+                if (std::none_of(isos.begin(), isos.end(), [&](float iso) {
+                        return iso >= bound.x && iso <= bound.y;
+                    })) {
+                    continue;
+                }
+                activeBricks.push_back(brick);
+                const size3_t lower = glm::max(brick, size3_t(1)) - size3_t(1);
+                const size3_t upper = glm::min(brick + size3_t(1), counts - size3_t(1));
+                lowest = glm::min(lowest, lower);
+                highest = glm::max(highest, upper);
+                for (size_t z = lower.z; z <= upper.z; ++z) {
+                    for (size_t y = lower.y; y <= upper.y; ++y) {
+                        for (size_t x = lower.x; x <= upper.x; ++x) {
+                            needed[brickIndex(size3_t(x, y, z))] = 1;
                         }
-                        
                     }
-                    
                 }
             }
         }
     }
+    if (activeBricks.empty()) {
+        MeshHelper mesh(dims, bricks.getModelMatrix(), bricks.getWorldMatrix());
+        mesh_.setData(createMesh(mesh));
+        return;
+    }
 
-    mesh_.setData(mesh.toBasicMesh());
+    // The slices are cut to the needed bricks in x and y, which bounds the scratch slices and the
+    // edge caches of the sweep by the extent of the surface rather than of the volume. The cells
+    // of the active blocks stay at least a brick away from the cut, so their gradients use the
+    // same central differences as without it.
+    const size3_t origin(lowest.x * brickSize, lowest.y * brickSize, 0);
+    const size3_t windowDims(std::min((highest.x + 1) * brickSize, dims.x) - origin.x,
+                             std::min((highest.y + 1) * brickSize, dims.y) - origin.y, dims.z);
+    const size3_t windowBlocks =
+        (windowDims - size3_t(1) + size3_t(brickSize - 1)) / brickSize;
+    std::vector<size_t> activeBlocks;
+    activeBlocks.reserve(activeBricks.size());
+    for (const auto& active : activeBricks) {
+        const size3_t block(active.x - lowest.x, active.y - lowest.y, active.z);
+        activeBlocks.push_back(block.x + windowBlocks.x * (block.y + windowBlocks.y * block.z));
+    }
+
+    // Maps the unit cube of the window into the unit cube of the volume
+    vec3 offset(0.0f);
+    vec3 extent(1.0f);
+    for (int i = 0; i < 2; ++i) {
+        offset[i] = static_cast<float>(origin[i]) / (dims[i] - 1);
+        extent[i] = static_cast<float>(windowDims[i] - 1) / (dims[i] - 1);
+    }
+    const mat4 modelMatrix = glm::scale(glm::translate(bricks.getModelMatrix(), offset), extent);
+
+    auto mesh = extractSlabs<float>(
+        windowDims, modelMatrix, bricks.getWorldMatrix(), isos, method_.get(), threads_.get(),
+        brickSize, &activeBlocks, [&](size_t z, float* scratch) {
+            const size_t bz = z / brickSize;
+            for (size_t by = lowest.y; by <= highest.y; ++by) {
+                for (size_t bx = lowest.x; bx <= highest.x; ++bx) {
+                    const size3_t current(bx, by, bz);
+                    if (!needed[brickIndex(current)]) {
+                        continue;
+                    }
+                    const size3_t brickOffset = current * brickSize - origin;
+                    const size3_t brickDims = bricks.getBrickDimensions(current);
+                    const auto voxels = bricks.getBrick(current);
+                    const float* src =
+                        voxels.get() + (z - brickOffset.z) * brickDims.x * brickDims.y;
+                    for (size_t y = 0; y < brickDims.y; ++y) {
+                        std::copy(src + y * brickDims.x, src + (y + 1) * brickDims.x,
+                                  scratch + brickOffset.x + (brickOffset.y + y) * windowDims.x);
+                    }
+                }
+            }
+            return scratch;
+        });
+    mesh_.setData(createMesh(mesh));
 }
 
-MarchingTetrahedra::MeshHelper::MeshHelper(std::shared_ptr<const Volume> vol)
-    : edgeToVertex_()
-    , vertices_()
-    , mesh_(std::make_shared<BasicMesh>())
-    , indexBuffer_(mesh_->addIndexBuffer(DrawType::Triangles, ConnectivityType::None)) {
-    mesh_->setModelMatrix(vol->getModelMatrix());
-    mesh_->setWorldMatrix(vol->getWorldMatrix());
+std::shared_ptr<Mesh> MarchingTetrahedra::createMesh(MeshHelper& mesh) const {
+    switch (vertexLayout_.get()) {
+        case VertexLayout::Compact:
+            return mesh.toCompactMesh(false);
+        case VertexLayout::Quantized:
+            return mesh.toCompactMesh(true);
+        case VertexLayout::Basic:
+        default:
+            return mesh.toBasicMesh();
+    }
 }
 
-void MarchingTetrahedra::MeshHelper::addTriangle(size_t i0, size_t i1, size_t i2) {
+std::uint64_t MarchingTetrahedra::extractToFile(const std::string& datFile,
+                                                const std::vector<float>& isoValues,
+                                                Method method, const std::string& meshFile,
+                                                const std::atomic<bool>& cancelled,
+                                                const std::function<void(float)>& progress) {
+    const auto header = util::readDatHeader(datFile);
+    const size3_t dims = header.dimensions;
+
+    MappedFile raw(header.rawFile);
+    if (raw.size() != dims.x * dims.y * dims.z * header.format->getSize()) {
+        throw Exception("Size of " + header.rawFile + " does not match " + datFile,
+                        IVW_CONTEXT_CUSTOM("MarchingTetrahedra::extractToFile"));
+    }
+
+    DataMapper dataMap(header.format);
+    dataMap.dataRange = header.dataRange;
+    dataMap.valueRange = header.valueRange;
+    std::vector<float> isos;
+    for (const float isoValue : isoValues) {
+        isos.push_back(
+            static_cast<float>(dataMap.mapFromValueToData(static_cast<double>(isoValue))));
+    }
+
+    mat4 modelMatrix(header.basis);
+    modelMatrix[3] = vec4(header.offset, 1.0f);
+    MeshFileWriter writer(meshFile, modelMatrix, header.worldMatrix);
+    MeshHelper mesh(dims, modelMatrix, header.worldMatrix, 0, isos.size());
+
+    dispatching::dispatch<void, dispatching::filter::Scalars>(header.format->getId(), FileSweep{},
+                                                              raw.data(), dims, isos, method, mesh,
+                                                              writer, cancelled, progress);
+
+    writer.close();
+    return writer.getTriangleCount();
+}
+
+std::vector<float> MarchingTetrahedra::getIsoValues() const {
+    std::string list = isoValueList_.get();
+    std::replace_if(
+        list.begin(), list.end(), [](char c) { return c == ',' || c == ';'; }, ' ');
+
+    std::vector<float> isos;
+    std::istringstream stream(list);
+    std::string token;
+    while (stream >> token) {
+        size_t end = 0;
+        try {
+            isos.push_back(std::stof(token, &end));
+        } catch (const std::exception&) {
+            end = 0;
+        }
+        if (end != token.size()) {
+            throw Exception("Invalid iso value '" + token + "' in the iso value list",
+                            IVW_CONTEXT);
+        }
+    }
+    if (isos.empty()) {
+        isos.push_back(isoValue_.get());
+    }
+    return isos;
+}
+
+MarchingTetrahedra::MeshHelper::MeshHelper(std::shared_ptr<const Volume> vol)
+    : MeshHelper(vol->getDimensions(), vol->getModelMatrix(), vol->getWorldMatrix()) {}
+
+MarchingTetrahedra::MeshHelper::MeshHelper(size3_t dims, const mat4& modelMatrix,
+                                           const mat4& worldMatrix, size_t firstSlice,
+                                           size_t levelCount)
+    : dims_(dims)
+    , firstSlice_(firstSlice)
+    , topSlice_(firstSlice)
+    , levelCount_(levelCount)
+    , edges_()
+    , edgeCacheDropped_(false)
+    , flushed_(0)
+    , shareFaces_(false)
+    , faceFirst_(0)
+    , faceLast_(0)
+    , modelMatrix_(modelMatrix)
+    , worldMatrix_(worldMatrix)
+    , positions_()
+    , normals_()
+    , indices_(levelCount) {}
+
+void MarchingTetrahedra::MeshHelper::addTriangle(size_t i0, size_t i1, size_t i2, size_t level) {
     IVW_ASSERT(i0 != i1, "i0 and i1 should not be the same value");
     IVW_ASSERT(i0 != i2, "i0 and i2 should not be the same value");
     IVW_ASSERT(i1 != i2, "i1 and i2 should not be the same value");
+    IVW_ASSERT(level < indices_.size(), "level should be below the level count");
+    IVW_TNM067LAB2_PROFILE_SCOPE(AddTriangle);
+    IVW_TNM067LAB2_PROFILE_COUNT(Triangles, 1);
 
-    indexBuffer_->add(static_cast<glm::uint32_t>(i0));
-    indexBuffer_->add(static_cast<glm::uint32_t>(i1));
-    indexBuffer_->add(static_cast<glm::uint32_t>(i2));
-
-    const auto a = std::get<0>(vertices_[i0]);
-    const auto b = std::get<0>(vertices_[i1]);
-    const auto c = std::get<0>(vertices_[i2]);
+    auto& indices = indices_[level];
+    indices.push_back(static_cast<std::uint32_t>(i0));
+    indices.push_back(static_cast<std::uint32_t>(i1));
+    indices.push_back(static_cast<std::uint32_t>(i2));
+}
 
-    const vec3 n = glm::normalize(glm::cross(b - a, c - a));
-    std::get<1>(vertices_[i0]) += n;
-    std::get<1>(vertices_[i1]) += n;
-    std::get<1>(vertices_[i2]) += n;
+void MarchingTetrahedra::MeshHelper::flush(MeshFileWriter& writer) {
+    writer.addVertices(positions_, normals_);
+    for (auto& indices : indices_) {
+        writer.addTriangles(indices);
+        indices.clear();
+    }
+    flushed_ += static_cast<std::uint32_t>(positions_.size());
+    positions_.clear();
+    normals_.clear();
 }
 
 std::shared_ptr<BasicMesh> MarchingTetrahedra::MeshHelper::toBasicMesh() {
-    for (auto& vertex : vertices_) {
-        std::get<0>(vertex) = glm::normalize(std::get<0>(vertex));
+    IVW_TNM067LAB2_PROFILE_SCOPE(MeshCreation);
+    auto mesh = std::make_shared<BasicMesh>();
+    mesh->setModelMatrix(modelMatrix_);
+    mesh->setWorldMatrix(worldMatrix_);
+
+    std::vector<BasicMesh::Vertex> vertices;
+    vertices.reserve(positions_.size());
+    for (size_t i = 0; i < positions_.size(); ++i) {
+        vertices.push_back(
+            {positions_[i], normals_[i], positions_[i], vec4(0.7f, 0.7f, 0.7f, 1.0f)});
     }
-    mesh_->addVertices(vertices_);
-    return mesh_;
+    mesh->addVertices(vertices);
+
+    for (auto& indices : indices_) {
+        auto indexBuffer = mesh->addIndexBuffer(DrawType::Triangles, ConnectivityType::None);
+        indexBuffer->getDataContainer() = std::move(indices);
+    }
+    return mesh;
+}
+
+std::shared_ptr<Mesh> MarchingTetrahedra::MeshHelper::toCompactMesh(bool quantizePositions) {
+    IVW_TNM067LAB2_PROFILE_SCOPE(MeshCreation);
+    auto mesh = std::make_shared<Mesh>(DrawType::Triangles, ConnectivityType::None);
+    mesh->setWorldMatrix(worldMatrix_);
+
+    if (quantizePositions) {
+        std::vector<glm::u16vec3> positions;
+        positions.reserve(positions_.size());
+        for (const auto& pos : positions_) {
+            positions.emplace_back(glm::round(glm::clamp(pos, 0.0f, 1.0f) * 65535.0f));
+        }
+        mesh->setModelMatrix(glm::scale(modelMatrix_, vec3(1.0f / 65535.0f)));
+        mesh->addBuffer(BufferType::PositionAttrib, util::makeBuffer(std::move(positions)));
+    } else {
+        mesh->setModelMatrix(modelMatrix_);
+        mesh->addBuffer(BufferType::PositionAttrib, util::makeBuffer(std::move(positions_)));
+    }
+
+    std::vector<glm::i16vec2> normals;
+    normals.reserve(normals_.size());
+    for (const auto& normal : normals_) {
+        normals.push_back(util::encodeOctahedral(normal));
+    }
+    mesh->addBuffer(BufferType::NormalAttrib, util::makeBuffer(std::move(normals)));
+
+    for (auto& indices : indices_) {
+        mesh->addIndices(Mesh::MeshInfo(DrawType::Triangles, ConnectivityType::None),
+                         util::makeIndexBuffer(std::move(indices)));
+    }
+    return mesh;
 }
 
-std::uint32_t MarchingTetrahedra::MeshHelper::addVertex(vec3 pos, size_t i, size_t j) {
+void MarchingTetrahedra::MeshHelper::clearSlice(size_t z) {
+    edges_[z & 1].clear();
+    topSlice_ = std::max(topSlice_, z);
+}
+
+void MarchingTetrahedra::MeshHelper::append(const MeshHelper& slab) {
+    IVW_ASSERT(slab.firstSlice_ == topSlice_, "slab should start at the top slice of this mesh");
+    IVW_ASSERT(flushed_ == 0 && slab.flushed_ == 0, "flushed meshes can not be appended");
+    IVW_ASSERT(slab.levelCount_ == levelCount_, "slab should have the same levels");
+
+    std::vector<std::uint32_t> remap(slab.positions_.size(), noVertex);
+    for (const auto& [key, vertex] : slab.bottomEdges_) {
+        remap[vertex] = edges_[topSlice_ & 1].find(key);
+    }
+
+    // No exact reservations, they would copy the mesh on every append of a long chain of slabs
+    for (size_t i = 0; i < slab.positions_.size(); ++i) {
+        if (remap[i] == noVertex) {
+            remap[i] = static_cast<std::uint32_t>(positions_.size());
+            positions_.push_back(slab.positions_[i]);
+            normals_.push_back(slab.normals_[i]);
+        }
+    }
+
+    for (size_t level = 0; level < slab.indices_.size(); ++level) {
+        auto& indices = indices_[level];
+        for (auto index : slab.indices_[level]) {
+            indices.push_back(remap[index]);
+        }
+    }
+
+    // The top slice of the slab is the new top slice, and the only one that is kept
+    edges_[0].clear();
+    edges_[1].clear();
+    auto& top = edges_[slab.topSlice_ & 1];
+    if (slab.edgeCacheDropped_) {
+        for (const auto& [key, vertex] : slab.topEdges_) {
+            top[key] = remap[vertex];
+        }
+    } else {
+        slab.edges_[slab.topSlice_ & 1].forEach(
+            [&](std::uint64_t key, std::uint32_t vertex) { top[key] = remap[vertex]; });
+    }
+    topSlice_ = slab.topSlice_;
+}
+
+void MarchingTetrahedra::MeshHelper::dropEdgeCache() {
+    if (edgeCacheDropped_) return;
+    topEdges_.clear();
+    edges_[topSlice_ & 1].forEach([&](std::uint64_t key, std::uint32_t vertex) {
+        topEdges_.emplace_back(key, vertex);
+    });
+    edges_[0] = EdgeTable();
+    edges_[1] = EdgeTable();
+    edgeCacheDropped_ = true;
+}
+
+auto MarchingTetrahedra::MeshHelper::findEdge(size_t i, size_t j, size_t level) -> EdgeSlot {
     IVW_ASSERT(i != j, "i and j should not be the same value");
+    IVW_ASSERT(!edgeCacheDropped_, "vertices can not be added after dropEdgeCache");
+    IVW_ASSERT(level < levelCount_, "level should be below the level count");
     if (j < i) std::swap(i, j);
 
-    auto [edgeIt, inserted] = edgeToVertex_.try_emplace(std::make_pair(i, j), vertices_.size());
-    if (inserted) {
-        vertices_.push_back({pos, vec3(0, 0, 0), pos, vec4(0.7f, 0.7f, 0.7f, 1.0f)});
+    const size_t sliceSize = dims_.x * dims_.y;
+    const size_t zi = i / sliceSize;
+    const size_t zj = j / sliceSize;
+    const size_t ri = i - zi * sliceSize;
+    const size_t rj = j - zj * sliceSize;
+    const size_t yi = ri / dims_.x;
+    const size_t yj = rj / dims_.x;
+    const size_t xi = ri - yi * dims_.x;
+    const size_t xj = rj - yj * dims_.x;
+
+    // Since i < j the edge either goes one slice up, one row up within the slice, or one voxel up
+    // within the row, which enumerates the directions as 0 to 12
+    const size_t direction = 9 * (zj - zi) + 3 * (yj + 1 - yi) + (xj + 1 - xi) - 5;
+    IVW_ASSERT(direction < edgeDirections, "i and j should be neighboring voxels");
+
+    const std::uint64_t key = (ri * edgeDirections + direction) * levelCount_ + level;
+    EdgeSlot edge{&edges_[zi & 1][key], key, zj == firstSlice_, false, 0};
+    if (shareFaces_) {
+        edge.shared = (xi == xj && (xi == faceFirst_.x || xi == faceLast_.x)) ||
+                      (yi == yj && (yi == faceFirst_.y || yi == faceLast_.y)) ||
+                      (zi == zj && (zi == faceFirst_.z || zi == faceLast_.z));
+        edge.volumeKey = key + zi * sliceSize * edgeDirections * levelCount_;
+    }
+    return edge;
+}
+
+void MarchingTetrahedra::MeshHelper::createVertex(const EdgeSlot& edge, const vec3& pos,
+                                                  const vec3& normal) {
+    *edge.vertex = flushed_ + static_cast<std::uint32_t>(positions_.size());
+    positions_.push_back(pos);
+    normals_.push_back(normal);
+    if (edge.bottom) {
+        bottomEdges_.emplace_back(edge.key, *edge.vertex);
+    }
+    if (edge.shared) {
+        sharedVertices_.emplace_back(*edge.vertex, edge.volumeKey);
+    }
+}
+
+void MarchingTetrahedra::MeshHelper::shareFaces(const size3_t& first, const size3_t& last) {
+    IVW_ASSERT(positions_.empty() && flushed_ == 0, "faces should be shared before any vertex");
+    shareFaces_ = true;
+    faceFirst_ = first;
+    faceLast_ = last;
+}
+
+MarchingTetrahedra::BlockSurface::BlockSurface(size_t levelCount)
+    : levelCount_(levelCount)
+    , blocks_()
+    , positions_()
+    , normals_()
+    , uses_()
+    , freeVertices_()
+    , vertexOfEdge_() {}
+
+auto MarchingTetrahedra::BlockSurface::makePiece(const size3_t& dims, size_t block) const
+    -> MeshHelper {
+    const size_t blockSize = MinMaxGrid::blockSize;
+    const size3_t cells = glm::max(dims, size3_t(1)) - size3_t(1);
+    const size3_t blocks = (cells + size3_t(blockSize - 1)) / blockSize;
+    const size3_t first =
+        size3_t(block % blocks.x, (block / blocks.x) % blocks.y, block / (blocks.x * blocks.y)) *
+        blockSize;
+
+    MeshHelper piece(dims, mat4(1.0f), mat4(1.0f), first.z, levelCount_);
+    piece.shareFaces(first, glm::min(first + size3_t(blockSize), cells));
+    return piece;
+}
+
+void MarchingTetrahedra::BlockSurface::remove(const std::vector<size_t>& blocks) {
+    for (const size_t index : blocks) {
+        const auto it = blocks_.find(index);
+        if (it == blocks_.end()) continue;
+        const Block& block = it->second;
+        freeVertices_.insert(freeVertices_.end(), block.vertices.begin(), block.vertices.end());
+        for (const auto& [vertex, key] : block.sharedVertices) {
+            if (--uses_[vertex] == 0) {
+                vertexOfEdge_.erase(key);
+                freeVertices_.push_back(vertex);
+            }
+        }
+        blocks_.erase(it);
+    }
+}
+
+void MarchingTetrahedra::BlockSurface::add(size_t index, const MeshHelper& piece) {
+    IVW_ASSERT(piece.shareFaces_ && piece.flushed_ == 0, "piece should be made by makePiece");
+    IVW_ASSERT(piece.levelCount_ == levelCount_, "piece should have the same levels");
+    IVW_ASSERT(blocks_.count(index) == 0, "block should have no triangles");
+    if (piece.positions_.empty()) {
+        return;
+    }
+
+    Block& block = blocks_[index];
+    std::vector<std::uint32_t> remap(piece.positions_.size(), MeshHelper::noVertex);
+    for (const auto& [vertex, key] : piece.sharedVertices_) {
+        const auto [it, inserted] = vertexOfEdge_.try_emplace(key, 0);
+        if (inserted) {
+            it->second = newVertex(piece.positions_[vertex], piece.normals_[vertex]);
+        }
+        ++uses_[it->second];
+        remap[vertex] = it->second;
+        block.sharedVertices.emplace_back(it->second, key);
+    }
+    for (size_t vertex = 0; vertex < remap.size(); ++vertex) {
+        if (remap[vertex] == MeshHelper::noVertex) {
+            remap[vertex] = newVertex(piece.positions_[vertex], piece.normals_[vertex]);
+            block.vertices.push_back(remap[vertex]);
+        }
+    }
+
+    block.triangles.resize(levelCount_);
+    for (size_t level = 0; level < levelCount_; ++level) {
+        const auto& indices = piece.indices_[level];
+        block.triangles[level].reserve(indices.size());
+        for (const auto index : indices) {
+            block.triangles[level].push_back(remap[index]);
+        }
+    }
+}
+
+auto MarchingTetrahedra::BlockSurface::toMeshHelper(const size3_t& dims, const mat4& modelMatrix,
+                                                    const mat4& worldMatrix) const
+    -> MeshHelper {
+    MeshHelper mesh(dims, modelMatrix, worldMatrix, 0, levelCount_);
+    mesh.positions_ = positions_;
+    mesh.normals_ = normals_;
+    for (size_t level = 0; level < levelCount_; ++level) {
+        size_t count = 0;
+        for (const auto& block : blocks_) {
+            count += block.second.triangles[level].size();
+        }
+        auto& indices = mesh.indices_[level];
+        indices.reserve(count);
+        for (const auto& block : blocks_) {
+            const auto& triangles = block.second.triangles[level];
+            indices.insert(indices.end(), triangles.begin(), triangles.end());
+        }
+    }
+    return mesh;
+}
+
+std::uint32_t MarchingTetrahedra::BlockSurface::newVertex(const vec3& pos, const vec3& normal) {
+    if (freeVertices_.empty()) {
+        positions_.push_back(pos);
+        normals_.push_back(normal);
+        uses_.push_back(0);
+        return static_cast<std::uint32_t>(positions_.size() - 1);
+    }
+    const std::uint32_t vertex = freeVertices_.back();
+    freeVertices_.pop_back();
+    positions_[vertex] = pos;
+    normals_[vertex] = normal;
+    uses_[vertex] = 0;
+    return vertex;
+}
+
+std::uint32_t& MarchingTetrahedra::MeshHelper::EdgeTable::operator[](std::uint64_t key) {
+    // At most half full, so that the probe sequences stay short
+    if (2 * (count_ + 1) > entries_.size()) {
+        grow();
+    }
+    for (size_t i = slot(key);; i = (i + 1) & (entries_.size() - 1)) {
+        auto& entry = entries_[i];
+        if (entry.key == key) {
+            return entry.vertex;
+        }
+        if (entry.key == noKey) {
+            entry = {key, noVertex};
+            ++count_;
+            return entry.vertex;
+        }
+    }
+}
+
+std::uint32_t MarchingTetrahedra::MeshHelper::EdgeTable::find(std::uint64_t key) const {
+    if (count_ == 0) return noVertex;
+    for (size_t i = slot(key);; i = (i + 1) & (entries_.size() - 1)) {
+        const auto& entry = entries_[i];
+        if (entry.key == key) return entry.vertex;
+        if (entry.key == noKey) return noVertex;
+    }
+}
+
+void MarchingTetrahedra::MeshHelper::EdgeTable::clear() {
+    if (count_ == 0) return;
+    std::fill(entries_.begin(), entries_.end(), Entry{noKey, noVertex});
+    count_ = 0;
+}
+
+size_t MarchingTetrahedra::MeshHelper::EdgeTable::slot(std::uint64_t key) const {
+    // Fibonacci hashing, the keys of neighboring edges are consecutive
+    return static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> shift_);
+}
+
+void MarchingTetrahedra::MeshHelper::EdgeTable::grow() {
+    std::vector<Entry> entries(std::max(entries_.size() * 2, size_t{64}), Entry{noKey, noVertex});
+    entries.swap(entries_);
+    shift_ = 64;
+    for (size_t size = entries_.size(); size > 1; size /= 2) {
+        --shift_;
+    }
+    count_ = 0;
+    for (const auto& entry : entries) {
+        if (entry.key != noKey) (*this)[entry.key] = entry.vertex;
     }
-    return static_cast<std::uint32_t>(edgeIt->second);
 }
 
 }  // namespace inviwo
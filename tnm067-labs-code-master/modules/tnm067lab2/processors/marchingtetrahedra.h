@@ -2,25 +2,49 @@
 
 #include <modules/tnm067lab2/tnm067lab2moduledefine.h>
 #include <inviwo/core/processors/processor.h>
+#include <inviwo/core/processors/progressbarowner.h>
 #include <inviwo/core/properties/ordinalproperty.h>
+#include <inviwo/core/properties/boolproperty.h>
+#include <inviwo/core/properties/optionproperty.h>
+#include <inviwo/core/properties/minmaxproperty.h>
+#include <inviwo/core/properties/stringproperty.h>
+#include <inviwo/core/properties/fileproperty.h>
+#include <inviwo/core/properties/buttonproperty.h>
+#include <inviwo/core/properties/compositeproperty.h>
 #include <inviwo/core/ports/imageport.h>
 #include <inviwo/core/ports/volumeport.h>
 #include <inviwo/core/ports/meshport.h>
+#include <inviwo/core/ports/datainport.h>
 #include <inviwo/core/datastructures/geometry/basicmesh.h>
+#include <modules/tnm067lab2/utils/brickedvolume.h>
+#include <modules/tnm067lab2/utils/extractionprofile.h>
+#include <modules/tnm067lab2/utils/minmaxgrid.h>
+#include <modules/tnm067lab2/utils/meshfile.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace inviwo {
 
-class IVW_MODULE_TNM067LAB2_API MarchingTetrahedra : public Processor {
+class VolumeRAM;
+
+class IVW_MODULE_TNM067LAB2_API MarchingTetrahedra : public Processor, public ProgressBarOwner {
 public:
-    struct HashFunc {
-        static size_t max;
-        size_t operator()(std::pair<size_t, size_t> p) const {
-            size_t asdf;
-            asdf = p.first;
-            asdf += p.second * max;
-            return std::hash<size_t>{}(asdf);
-        }
-    };
+    enum class VertexLayout { Basic, Compact, Quantized };
+    /**
+     * Triangulation of the cells. Tetrahedra splits every cell into six tetrahedra around the
+     * same diagonal, FiveTetrahedra into five with the orientation alternating between cells.
+     * Cubes creates the fewest triangles but does not resolve ambiguous cells by topology.
+     */
+    enum class Method { Tetrahedra, FiveTetrahedra, Cubes };
 
     struct Voxel {
         vec3 pos;
@@ -32,13 +56,19 @@ public:
         Voxel voxels[8];
     };
 
-    struct Tetrahedra {
-        Voxel voxels[4];
-    };
+    class BlockSurface;
 
     struct MeshHelper {
 
         MeshHelper(std::shared_ptr<const Volume> vol);
+        /**
+         * @param firstSlice the lowest slice of the cells that will be extracted into this
+         * helper, the vertices on that slice are remembered so that append can weld them
+         * @param levelCount the number of iso values, each gets its own triangles while the
+         * vertices and the edge cache are shared
+         */
+        MeshHelper(size3_t dims, const mat4& modelMatrix, const mat4& worldMatrix,
+                   size_t firstSlice = 0, size_t levelCount = 1);
 
         /**
          * Adds a vertex to the mesh. The input parameters i and j are the voxel-indices of the two
@@ -47,34 +77,359 @@ public:
          * the created vertex or the vertex that was created for this edge before. The voxel-index i
          * and j can be given in any order.
          *
-         * @param pos spatial position of the vertex
+         * The two voxels have to be neighbors (also diagonally) and the edges are only remembered
+         * for the two most recent slices, see clearSlice.
+         *
          * @param i voxel index of first voxel of the edge
          * @param j voxel index of second voxel of the edge
+         * @param vertex callable returning the spatial position and the normal of the vertex as
+         * a std::pair<vec3, vec3>, only called if the vertex has to be created
+         * @param level the iso value of the vertex, the levels do not share vertices
+         */
+        template <typename F>
+        std::uint32_t addVertex(size_t i, size_t j, F vertex, size_t level = 0) {
+            EdgeSlot edge;
+            {
+                IVW_TNM067LAB2_PROFILE_SCOPE(EdgeLookup);
+                edge = findEdge(i, j, level);
+            }
+            if (*edge.vertex == noVertex) {
+                IVW_TNM067LAB2_PROFILE_COUNT(EdgeMisses, 1);
+                IVW_TNM067LAB2_PROFILE_SCOPE(Interpolation);
+                const auto [pos, normal] = vertex();
+                createVertex(edge, pos, normal);
+            } else {
+                IVW_TNM067LAB2_PROFILE_COUNT(EdgeHits, 1);
+            }
+            return *edge.vertex;
+        }
+        void addTriangle(size_t i0, size_t i1, size_t i2, size_t level = 0);
+        /**
+         * Forgets the vertices of the edges starting in slice z. The edge cache only covers two
+         * slices, so this has to be called before the cells between slice z - 1 and z are visited.
+         */
+        void clearSlice(size_t z);
+        /**
+         * Appends the vertices and triangles of a helper that extracted the cells directly above
+         * the ones of this helper, i.e. slab has to start at the top slice of this helper. The
+         * vertices of the shared slice are welded. The vertices of slab are appended in order,
+         * so the result only depends on the order of the appends.
+         */
+        void append(const MeshHelper& slab);
+        /**
+         * Releases the edge cache except the edges of the top slice, which is all that append needs
+         * of a slab. Used for slabs that are kept to be appended later, no vertices can be added
+         * afterwards.
+         */
+        void dropEdgeCache();
+        /**
+         * Writes the vertices and triangles to writer and drops them from memory. The edge cache
+         * stays valid, so the extraction can continue after a flush. Can not be combined with
+         * append or the conversions to meshes.
+         */
+        void flush(MeshFileWriter& writer);
+        /**
+         * Creates a BasicMesh with one index buffer per iso value
          */
-        std::uint32_t addVertex(vec3 pos, size_t i, size_t j);
-        void addTriangle(size_t i0, size_t i1, size_t i2);
         std::shared_ptr<BasicMesh> toBasicMesh();
+        /**
+         * Creates a mesh with only positions (vec3) and octahedral normals (i16vec2, see
+         * util::encodeOctahedral). With quantizePositions the positions are stored as u16vec3
+         * over the unit cube and the model matrix is scaled by 1/65535 to dequantize them.
+         */
+        std::shared_ptr<Mesh> toCompactMesh(bool quantizePositions);
 
     private:
-        std::unordered_map<std::pair<size_t, size_t>, size_t, HashFunc> edgeToVertex_;
-        std::vector<BasicMesh::Vertex> vertices_;
-        std::shared_ptr<BasicMesh> mesh_;
-        std::shared_ptr<IndexBufferRAM> indexBuffer_;
+        // An edge is stored at its endpoint with the lowest voxel index, which leaves 13
+        // directions to its neighbors with a higher index
+        static constexpr size_t edgeDirections = 13;
+        static constexpr std::uint32_t noVertex = std::numeric_limits<std::uint32_t>::max();
+
+        /**
+         * The vertices of the crossed edges of one slice by the key of their edge and level, an
+         * open addressing hash table. Its size follows the surface rather than the slice.
+         */
+        class EdgeTable {
+        public:
+            /**
+             * Returns the entry of key, which is added as noVertex if it is missing
+             */
+            std::uint32_t& operator[](std::uint64_t key);
+            /**
+             * Returns the vertex of key, noVertex if it is missing
+             */
+            std::uint32_t find(std::uint64_t key) const;
+            void clear();
+            template <typename F>
+            void forEach(F f) const {
+                for (const auto& entry : entries_) {
+                    if (entry.key != noKey) f(entry.key, entry.vertex);
+                }
+            }
+
+        private:
+            static constexpr std::uint64_t noKey = std::numeric_limits<std::uint64_t>::max();
+            struct Entry {
+                std::uint64_t key;
+                std::uint32_t vertex;
+            };
+            size_t slot(std::uint64_t key) const;
+            void grow();
+
+            std::vector<Entry> entries_;
+            size_t count_ = 0;
+            int shift_ = 64;
+        };
+
+        struct EdgeSlot {
+            std::uint32_t* vertex;  // entry in edges_
+            std::uint64_t key;      // key of the edge and level within its slice
+            bool bottom;            // if the edge lies within firstSlice_
+            bool shared;            // if the edge lies on a face of the box of shareFaces
+            std::uint64_t volumeKey;  // key of the edge and level within the volume
+        };
+        EdgeSlot findEdge(size_t i, size_t j, size_t level);
+        void createVertex(const EdgeSlot& edge, const vec3& pos, const vec3& normal);
+        /**
+         * Remembers the vertices on the faces of the box of voxels [first, last] with the keys of
+         * their edges within the volume, see sharedVertices_. Used by BlockSurface, has to be
+         * called before vertices are added.
+         */
+        void shareFaces(const size3_t& first, const size3_t& last);
+        friend class BlockSurface;
+
+        size3_t dims_;
+        size_t firstSlice_;
+        size_t topSlice_;
+        size_t levelCount_;
+        // Edges of the even and odd slices, empty after dropEdgeCache
+        EdgeTable edges_[2];
+        bool edgeCacheDropped_;
+        // Number of vertices written by flush, vertex indices count them as well
+        std::uint32_t flushed_;
+        // (key, vertex) of the edges within firstSlice_, key as in edges_
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> bottomEdges_;
+        // (key, vertex) of the edges within topSlice_, only set by dropEdgeCache
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> topEdges_;
+        // Box of shareFaces, the faces are only tracked if shareFaces_ is set
+        bool shareFaces_;
+        size3_t faceFirst_;
+        size3_t faceLast_;
+        // (vertex, key) of the vertices on the faces of the box, key as in EdgeSlot::volumeKey
+        std::vector<std::pair<std::uint32_t, std::uint64_t>> sharedVertices_;
+        mat4 modelMatrix_;
+        mat4 worldMatrix_;
+        std::vector<vec3> positions_;
+        std::vector<vec3> normals_;
+        // Triangles per iso value
+        std::vector<std::vector<std::uint32_t>> indices_;
+    };
+
+    /**
+     * Welded surface of the blocks of cells of a volume, in which the surface of single blocks
+     * can be replaced, see processIncremental. The vertices on the faces of the blocks are
+     * identified by their edges, so neighboring blocks share them, and a vertex is freed once no
+     * block uses it.
+     */
+    class BlockSurface {
+    public:
+        explicit BlockSurface(size_t levelCount = 1);
+
+        /**
+         * Returns an empty helper for the cells of block, see MinMaxGrid, that remembers the
+         * vertices on the faces of the block for add
+         */
+        MeshHelper makePiece(const size3_t& dims, size_t block) const;
+        /**
+         * Removes the triangles of the blocks, and the vertices that no other block uses
+         */
+        void remove(const std::vector<size_t>& blocks);
+        /**
+         * Adds the triangles of a block that has none, from a piece made by makePiece. The
+         * vertices on the faces of the block are welded to those of its neighbors.
+         */
+        void add(size_t block, const MeshHelper& piece);
+        /**
+         * Returns a helper with the triangles of all blocks, in the order of the blocks. Freed
+         * vertices are kept until they are reused, but no triangle refers to them.
+         */
+        MeshHelper toMeshHelper(const size3_t& dims, const mat4& modelMatrix,
+                                const mat4& worldMatrix) const;
+
+    private:
+        struct Block {
+            // The vertices only this block uses
+            std::vector<std::uint32_t> vertices;
+            // (vertex, key) of the vertices on the faces of the block, see vertexOfEdge_
+            std::vector<std::pair<std::uint32_t, std::uint64_t>> sharedVertices;
+            // Triangles per iso value
+            std::vector<std::vector<std::uint32_t>> triangles;
+        };
+        std::uint32_t newVertex(const vec3& pos, const vec3& normal);
+
+        size_t levelCount_;
+        std::map<size_t, Block> blocks_;
+        std::vector<vec3> positions_;
+        std::vector<vec3> normals_;
+        // Number of blocks that use each shared vertex
+        std::vector<std::uint32_t> uses_;
+        std::vector<std::uint32_t> freeVertices_;
+        // Shared vertices by the keys of their edges, see MeshHelper::EdgeSlot::volumeKey
+        std::unordered_map<std::uint64_t, std::uint32_t> vertexOfEdge_;
     };
 
     MarchingTetrahedra();
-    virtual ~MarchingTetrahedra() = default;
+    virtual ~MarchingTetrahedra();
 
     virtual void process() override;
 
     virtual const ProcessorInfo getProcessorInfo() const override;
     static const ProcessorInfo processorInfo_;
 
+    /**
+     * Extracts the iso surfaces of the volume described by datFile into a mesh file, see
+     * MeshFileWriter. The raw file is memory mapped and swept in one pass, and the triangles are
+     * written after every layer of cells, so the memory use is bounded by a few slices of the
+     * volume. The iso values are given in value space and their triangles are written to the
+     * one triangle list of the file. progress, if set, is called with the extracted fraction
+     * after every layer, and once cancelled is set the extraction throws an Exception and
+     * meshFile is left untouched.
+     * @return the number of triangles written
+     */
+    static std::uint64_t extractToFile(const std::string& datFile,
+                                       const std::vector<float>& isoValues, Method method,
+                                       const std::string& meshFile,
+                                       const std::atomic<bool>& cancelled,
+                                       const std::function<void(float)>& progress = nullptr);
+
 private:
+    /**
+     * Extracts the mesh of the connected input, see processBricks, processProgressive and
+     * processIncremental
+     */
+    void extract();
+#ifdef IVW_TNM067LAB2_PROFILING
+    /**
+     * Shows the profile of the extractions since the last call in profile_ and in the log
+     */
+    void showProfile();
+#endif
+    void updateIsoValueRange(dvec2 valueRange);
+    /**
+     * Extracts the iso surface from a bricked volume. Bricks whose bound excludes the iso value
+     * are skipped without being generated, and the slices of the sweep only cover the needed
+     * bricks in x and y.
+     */
+    void processBricks(const BrickedVolume& bricks);
+    /**
+     * Extracts the iso surfaces one block at a time and keeps them in a BlockSurface. When the
+     * volume changes only the changed blocks, and the blocks around them whose gradients reach
+     * into those, are extracted again and replaced, see MinMaxGrid::update.
+     */
+    void processIncremental(const VolumeRAM& volume, const std::vector<float>& isos,
+                            const std::vector<size_t>& activeBlocks,
+                            const std::vector<size_t>& changedBlocks);
+    /**
+     * Publishes a surface extracted at every 4th voxel right away and refines it at every 2nd
+     * and every voxel on the thread pool, one slice at a time in a single task. Each refinement
+     * is published when it is done, and dropped if the volume, the iso values or the method
+     * change before. The final surface is kept, later calls only create the mesh again.
+     */
+    void processProgressive(const std::vector<float>& isos,
+                            const std::vector<size_t>& activeBlocks, bool volumeChanged);
+    void startRefinement(const std::vector<float>& isos, const std::vector<size_t>& activeBlocks,
+                         size_t stride);
+    void cancelRefinement();
+    /**
+     * Extracts the iso values of getIsoValues from outOfCoreVolume_ into outOfCoreMesh_ on the
+     * thread pool, see extractToFile. The progress is shown on the progress bar and
+     * outOfCoreExtract_ cancels the extraction while it runs.
+     */
+    void startFileExtraction();
+    void finishFileExtraction();
+    /**
+     * Extracts the iso surfaces within the voxels [first, last] of the volume only. The slices are
+     * cut to the region, and a block of cells in the region is visited if it overlaps an active
+     * block of minMaxGrid_. The normals on the faces of the region use one-sided differences.
+     */
+    void processRegion(const VolumeRAM& volume, const std::vector<float>& isos,
+                       const std::vector<size_t>& activeBlocks, const size3_t& first,
+                       const size3_t& last);
+    std::shared_ptr<Mesh> createMesh(MeshHelper& mesh) const;
+    /**
+     * Returns the iso values of isoValueList_, or isoValue_ if the list is empty
+     */
+    std::vector<float> getIsoValues() const;
+
     VolumeInport volume_;
+    DataInport<BrickedVolume> bricks_;
     MeshOutport mesh_;
 
     FloatProperty isoValue_;
+    // Iso values separated by spaces or commas, extracted in one sweep into one index buffer each
+    StringProperty isoValueList_;
+    TemplateOptionProperty<Method> method_;
+    IntSizeTProperty threads_;
+    TemplateOptionProperty<VertexLayout> vertexLayout_;
+    // Keeps the surface of every block, about a second copy of the mesh, and hashes the volume
+    // on every change to re-extract only the blocks next to changes, see processIncremental
+    BoolProperty reuseBlocks_;
+    BoolProperty progressive_;
+    // Region of interest in normalized volume coordinates, the whole volume by default
+    CompositeProperty roi_;
+    FloatMinMaxProperty roiX_;
+    FloatMinMaxProperty roiY_;
+    FloatMinMaxProperty roiZ_;
+    CompositeProperty outOfCore_;
+    FileProperty outOfCoreVolume_;
+    FileProperty outOfCoreMesh_;
+    ButtonProperty outOfCoreExtract_;
+#ifdef IVW_TNM067LAB2_PROFILING
+    // Read-only, one per ExtractionProfile::Stage and ExtractionProfile::Counter
+    CompositeProperty profile_;
+    std::vector<std::unique_ptr<DoubleProperty>> stageTimes_;
+    std::vector<std::unique_ptr<IntSizeTProperty>> counts_;
+#endif
+
+    // Block ranges of the input volume, built on first use and updated when the volume changes
+    std::unique_ptr<MinMaxGrid> minMaxGrid_;
+    bool volumeChanged_ = false;
+
+    // Surface of the last extraction per block, and what it was extracted with, see
+    // processIncremental
+    struct BlockCache {
+        std::vector<float> isos;
+        Method method = Method::Tetrahedra;
+        const DataFormatBase* format = nullptr;
+        size3_t dims{0};
+        BlockSurface surface = BlockSurface(1);
+    };
+    BlockCache blockCache_;
+
+    // Surface of a progressive extraction that is refined on the thread pool, see
+    // processProgressive. Shared with the task, which only touches the processor if the
+    // refinement has not been cancelled.
+    struct Refinement {
+        std::shared_ptr<const Volume> volume;
+        std::vector<float> isos;
+        Method method = Method::Tetrahedra;
+        size_t stride = 1;
+        std::atomic<bool> cancelled{false};
+        std::future<MeshHelper> result;
+        // The final surface, once the refinement at every voxel is done
+        std::unique_ptr<MeshHelper> surface;
+    };
+    std::shared_ptr<Refinement> refinement_;
+
+    // Extraction started by outOfCoreExtract_, which runs on the thread pool, see
+    // startFileExtraction. Shared with the task, which only touches the processor if the
+    // processor has not been destroyed.
+    struct FileExtraction {
+        std::atomic<bool> cancelled{false};
+        // Only accessed on the front thread
+        bool destroyed = false;
+    };
+    std::shared_ptr<FileExtraction> fileExtraction_;
 };
 
 }  // namespace inviwo
@@ -0,0 +1,41 @@
+#include <modules/tnm067lab2/processors/meshdecimation.h>
+#include <modules/tnm067lab2/utils/meshdecimation.h>
+#include <inviwo/core/datastructures/geometry/basicmesh.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace inviwo {
+
+const ProcessorInfo MeshDecimation::processorInfo_{
+    "org.inviwo.MeshDecimation",  // Class identifier
+    "Mesh Decimation",            // Display name
+    "TNM067",                     // Category
+    CodeState::Experimental,      // Code state
+    Tags::None,                   // Tags
+};
+const ProcessorInfo MeshDecimation::getProcessorInfo() const { return processorInfo_; }
+
+MeshDecimation::MeshDecimation()
+    : Processor()
+    , inport_("inport")
+    , outport_("outport")
+    , targetRatio_("targetRatio", "Target triangle ratio", 0.2f, 0.01f, 1.0f)
+    , maxError_("maxError", "Max error", 0.0f, 0.0f, 0.05f)
+    , threads_("threads", "Threads",
+               std::max(size_t{1}, size_t{std::thread::hardware_concurrency()}), 1, 64) {
+
+    addPort(inport_);
+    addPort(outport_);
+
+    addProperty(targetRatio_);
+    addProperty(maxError_);
+    addProperty(threads_);
+}
+
+void MeshDecimation::process() {
+    outport_.setData(util::decimateMesh(*inport_.getData(), targetRatio_.get(), maxError_.get(),
+                                        threads_.get()));
+}
+
+}  // namespace inviwo
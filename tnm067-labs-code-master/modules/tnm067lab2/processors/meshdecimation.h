@@ -0,0 +1,34 @@
+#pragma once
+
+#include <modules/tnm067lab2/tnm067lab2moduledefine.h>
+#include <inviwo/core/processors/processor.h>
+#include <inviwo/core/properties/ordinalproperty.h>
+#include <inviwo/core/ports/meshport.h>
+
+namespace inviwo {
+
+/**
+ * Reduces the triangles of a mesh, e.g. from MarchingTetrahedra, with parallel quadric error
+ * edge collapses, see util::decimateMesh
+ */
+class IVW_MODULE_TNM067LAB2_API MeshDecimation : public Processor {
+public:
+    MeshDecimation();
+    virtual ~MeshDecimation() = default;
+
+    virtual void process() override;
+
+    virtual const ProcessorInfo getProcessorInfo() const override;
+    static const ProcessorInfo processorInfo_;
+
+private:
+    MeshInport inport_;
+    MeshOutport outport_;
+
+    FloatProperty targetRatio_;
+    // Largest distance a collapse may move the surface, 0 for no limit
+    FloatProperty maxError_;
+    IntSizeTProperty threads_;
+};
+
+}  // namespace inviwo
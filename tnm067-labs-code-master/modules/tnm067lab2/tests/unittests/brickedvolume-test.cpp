@@ -0,0 +1,89 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <gtest/gtest.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab2/utils/brickedvolume.h>
+
+#include <algorithm>
+
+namespace inviwo {
+
+TEST(BrickedVolumeTest, generatesBricksOnFirstAccess) {
+    const size3_t dims(70, 40, 33);
+    BrickedVolume volume(
+        dims,
+        [](size3_t offset, size3_t brickDims, float* data) {
+            size3_t pos{};
+            for (pos.z = 0; pos.z < brickDims.z; ++pos.z) {
+                for (pos.y = 0; pos.y < brickDims.y; ++pos.y) {
+                    for (pos.x = 0; pos.x < brickDims.x; ++pos.x) {
+                        const size3_t p = offset + pos;
+                        *data++ = static_cast<float>(p.x + 100 * p.y + 10000 * p.z);
+                    }
+                }
+            }
+        },
+        [](size3_t, size3_t) { return dvec2(0.0, 1e6); });
+
+    EXPECT_EQ(size3_t(3, 2, 2), volume.getBrickCounts());
+    EXPECT_EQ(size3_t(6, 8, 1), volume.getBrickDimensions(size3_t(2, 1, 1)));
+    EXPECT_EQ(0u, volume.getComputedBrickCount());
+
+    EXPECT_EQ(69.0f + 100.0f * 39.0f + 10000.0f * 32.0f, volume.getVoxel(size3_t(69, 39, 32)));
+    EXPECT_EQ(5.0f + 100.0f * 33.0f, volume.getVoxel(size3_t(5, 33, 0)));
+    EXPECT_EQ(2u, volume.getComputedBrickCount());
+
+    volume.getVoxel(size3_t(6, 34, 1));
+    EXPECT_EQ(2u, volume.getComputedBrickCount());
+}
+
+TEST(BrickedVolumeTest, dropsOldestBricksBeyondBudget) {
+    const size_t brickBytes = BrickedVolume::brickSize * BrickedVolume::brickSize *
+                              BrickedVolume::brickSize * sizeof(float);
+    BrickedVolume volume(
+        size3_t(3 * BrickedVolume::brickSize),
+        [](size3_t offset, size3_t brickDims, float* data) {
+            std::fill(data, data + brickDims.x * brickDims.y * brickDims.z,
+                      static_cast<float>(offset.x));
+        },
+        [](size3_t, size3_t) { return dvec2(0.0, 1e6); }, 2 * brickBytes);
+
+    const auto first = volume.getBrick(size3_t(0));
+    volume.getBrick(size3_t(1, 0, 0));
+    volume.getBrick(size3_t(2, 0, 0));
+    EXPECT_EQ(2 * brickBytes, volume.getRetainedBytes());
+    EXPECT_EQ(3u, volume.getComputedBrickCount());
+
+    // The dropped brick stays valid for its holder and is generated again on the next access
+    EXPECT_EQ(0.0f, first[0]);
+    EXPECT_EQ(0.0f, volume.getVoxel(size3_t(1)));
+    EXPECT_EQ(4u, volume.getComputedBrickCount());
+    EXPECT_EQ(64.0f, volume.getVoxel(size3_t(64, 0, 0)));
+    EXPECT_EQ(4u, volume.getComputedBrickCount());
+}
+
+TEST(BrickedVolumeTest, keepsRecentlyAccessedBricks) {
+    const size_t brickBytes = BrickedVolume::brickSize * BrickedVolume::brickSize *
+                              BrickedVolume::brickSize * sizeof(float);
+    BrickedVolume volume(
+        size3_t(3 * BrickedVolume::brickSize),
+        [](size3_t offset, size3_t brickDims, float* data) {
+            std::fill(data, data + brickDims.x * brickDims.y * brickDims.z,
+                      static_cast<float>(offset.x));
+        },
+        [](size3_t, size3_t) { return dvec2(0.0, 1e6); }, 2 * brickBytes);
+
+    // The first brick is accessed again before the third is generated, so the second is dropped
+    volume.getBrick(size3_t(0));
+    volume.getBrick(size3_t(1, 0, 0));
+    volume.getBrick(size3_t(0));
+    volume.getBrick(size3_t(2, 0, 0));
+    EXPECT_EQ(3u, volume.getComputedBrickCount());
+    EXPECT_EQ(0.0f, volume.getVoxel(size3_t(0)));
+    EXPECT_EQ(3u, volume.getComputedBrickCount());
+    EXPECT_EQ(32.0f, volume.getVoxel(size3_t(32, 0, 0)));
+    EXPECT_EQ(4u, volume.getComputedBrickCount());
+}
+
+}  // namespace inviwo
@@ -0,0 +1,68 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <gtest/gtest.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab2/utils/datvolumeio.h>
+#include <inviwo/core/util/formats.h>
+
+#include <filesystem>
+#include <fstream>
+
+namespace inviwo {
+
+TEST(DatVolumeIOTest, readHeader) {
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto dat = dir / "tnm067lab2-header-test.dat";
+    {
+        std::ofstream out(dat);
+        out << "RawFile: UVWf39.raw\n"
+               "Resolution: 500 500 100\n"
+               "Format: FLOAT32\n"
+               "BasisVector1: 2139 0 0\n"
+               "BasisVector2: 0 2004 0\n"
+               "BasisVector3: 0 0 20.185\n"
+               "Offset: -1069.5 -1002 -10.0925\n"
+               "DataRange: -306.637 306.637\n"
+               "ValueRange: -286.103 306.637\n"
+               "Unit: km/h\n";
+    }
+
+    const auto header = util::readDatHeader(dat.string());
+    std::filesystem::remove(dat);
+
+    EXPECT_EQ((dir / "UVWf39.raw").lexically_normal().string(), header.rawFile);
+    EXPECT_EQ(size3_t(500, 500, 100), header.dimensions);
+    EXPECT_EQ(DataFloat32::get(), header.format);
+    EXPECT_FLOAT_EQ(2004.0f, header.basis[1].y);
+    EXPECT_FLOAT_EQ(-10.0925f, header.offset.z);
+    EXPECT_DOUBLE_EQ(-286.103, header.valueRange.x);
+}
+
+TEST(DatVolumeIOTest, incompleteHeaderThrows) {
+    const auto dat = std::filesystem::temp_directory_path() / "tnm067lab2-incomplete-test.dat";
+    {
+        std::ofstream out(dat);
+        out << "Resolution: 16 16 16\n";
+    }
+    EXPECT_THROW(util::readDatHeader(dat.string()), Exception);
+    std::filesystem::remove(dat);
+}
+
+TEST(DatVolumeIOTest, invalidVectorIndexThrows) {
+    const auto dat = std::filesystem::temp_directory_path() / "tnm067lab2-malformed-test.dat";
+    for (const char* vector :
+         {"BasisVector0: 1 0 0", "BasisVector4: 1 0 0", "WorldVector5: 1 0 0 0"}) {
+        {
+            std::ofstream out(dat);
+            out << "RawFile: volume.raw\n"
+                   "Resolution: 16 16 16\n"
+                   "Format: FLOAT32\n"
+                << vector << "\n";
+        }
+        EXPECT_THROW(util::readDatHeader(dat.string()), Exception) << vector;
+    }
+    std::filesystem::remove(dat);
+}
+
+}  // namespace inviwo
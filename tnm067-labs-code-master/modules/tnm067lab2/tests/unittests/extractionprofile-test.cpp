@@ -0,0 +1,40 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <gtest/gtest.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab2/utils/extractionprofile.h>
+
+#include <thread>
+
+namespace inviwo {
+
+TEST(ExtractionProfileTest, collectsThreads) {
+    using Counter = ExtractionProfile::Counter;
+    using Stage = ExtractionProfile::Stage;
+    ExtractionProfile::collect();
+    ExtractionProfile::takeTotal();
+
+    std::thread worker([]() {
+        ExtractionProfile::local().add(Counter::EdgeHits, 3);
+        ExtractionProfile::local().add(Stage::AddTriangle, std::chrono::milliseconds(2));
+        ExtractionProfile::collect();
+    });
+    worker.join();
+    ExtractionProfile::local().add(Counter::EdgeHits, 1);
+    ExtractionProfile::local().add(Counter::EdgeMisses, 4);
+    { ExtractionProfile::Timer timer(Stage::MeshCreation); }
+    ExtractionProfile::collect();
+
+    const auto total = ExtractionProfile::takeTotal();
+    EXPECT_EQ(4u, total.count(Counter::EdgeHits));
+    EXPECT_EQ(4u, total.count(Counter::EdgeMisses));
+    EXPECT_DOUBLE_EQ(2.0, total.milliseconds(Stage::AddTriangle));
+    EXPECT_NE(std::string::npos, total.summary().find("50.00 %"));
+
+    // Taking the total clears it, as does collecting a thread
+    EXPECT_EQ(0u, ExtractionProfile::takeTotal().count(Counter::EdgeHits));
+    EXPECT_EQ(0u, ExtractionProfile::local().count(Counter::EdgeHits));
+}
+
+}  // namespace inviwo
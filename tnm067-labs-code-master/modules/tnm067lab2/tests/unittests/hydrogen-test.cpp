@@ -4,6 +4,17 @@
 #include <warn/pop>
 
 #include <modules/tnm067lab2/processors/hydrogengenerator.h>
+#include <modules/tnm067lab2/utils/hydrogenorbital.h>
+#include <inviwo/core/datastructures/volume/volume.h>
+#include <inviwo/core/datastructures/volume/volumeram.h>
+#include <inviwo/core/ports/volumeport.h>
+#include <inviwo/core/properties/boolproperty.h>
+#include <inviwo/core/properties/optionproperty.h>
+#include <inviwo/core/properties/ordinalproperty.h>
+
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace inviwo {
 
@@ -153,4 +164,146 @@ TEST(HydrogenTest, eval) {
         EXPECT_NEAR(p.second, res, 0.000000001);
     }
 }
-}  // namespace inviwo
\ No newline at end of file
+
+TEST(HydrogenTest, evalMirrorSymmetric) {
+    for (const auto& p : toTestEval) {
+        const auto res = HydrogenGenerator::eval(p.first);
+        EXPECT_EQ(res, HydrogenGenerator::eval(vec3(-p.first.x, p.first.y, p.first.z)));
+        EXPECT_EQ(res, HydrogenGenerator::eval(vec3(p.first.x, -p.first.y, p.first.z)));
+        EXPECT_EQ(res, HydrogenGenerator::eval(vec3(p.first.x, p.first.y, -p.first.z)));
+        EXPECT_EQ(res, HydrogenGenerator::eval(-p.first));
+    }
+}
+
+TEST(HydrogenTest, mirroredOctantMatchesFullEvaluation) {
+    // Returns the bytes of the density and gradient volumes of the 3d orbital with m = -1
+    const auto generate = [](size_t size, bool exploitSymmetry) {
+        HydrogenGenerator generator;
+        VolumeInport volume("volume");
+        VolumeInport gradient("gradient");
+        volume.connectTo(generator.getOutport("volume"));
+        gradient.connectTo(generator.getOutport("gradient"));
+        dynamic_cast<IntSizeTProperty*>(generator.getPropertyByIdentifier("size_"))->set(size);
+        dynamic_cast<IntProperty*>(generator.getPropertyByIdentifier("m"))->set(-1);
+        dynamic_cast<BoolProperty*>(generator.getPropertyByIdentifier("exploitSymmetry"))
+            ->set(exploitSymmetry);
+        generator.process();
+
+        std::vector<std::vector<char>> bytes;
+        for (const auto& port : {&volume, &gradient}) {
+            const auto ram = port->getData()->getRepresentation<VolumeRAM>();
+            const auto data = static_cast<const char*>(ram->getData());
+            bytes.emplace_back(data, data + size * size * size * ram->getDataFormat()->getSize());
+        }
+        return bytes;
+    };
+
+    for (const size_t size : {4, 5, 16, 17, 33}) {
+        const auto mirrored = generate(size, true);
+        const auto evaluated = generate(size, false);
+        EXPECT_TRUE(mirrored[0] == evaluated[0]) << "density, size " << size;
+        EXPECT_TRUE(mirrored[1] == evaluated[1]) << "gradient, size " << size;
+    }
+}
+
+TEST(HydrogenTest, outputFormatsMapBackToDensity) {
+    const HydrogenOrbital orbital(3, 2, 1);
+    const size_t size = 17;
+    // The largest error of a voxel in [0, 1] after mapping back to density, as a fraction
+    const std::vector<std::pair<std::string, double>> formats{
+        {"float32", 0.0}, {"float16", 1.0 / 2048.0}, {"uint16", 0.5 / 65535.0},
+        {"uint8", 0.5 / 255.0}};
+    for (const auto& [format, step] : formats) {
+        HydrogenGenerator generator;
+        VolumeInport volume("volume");
+        volume.connectTo(generator.getOutport("volume"));
+        dynamic_cast<IntSizeTProperty*>(generator.getPropertyByIdentifier("size_"))->set(size);
+        dynamic_cast<IntProperty*>(generator.getPropertyByIdentifier("m"))->set(1);
+        dynamic_cast<BaseOptionProperty*>(generator.getPropertyByIdentifier("outputFormat"))
+            ->setSelectedIdentifier(format);
+        generator.process();
+
+        const auto result = volume.getData();
+        const auto ram = result->getRepresentation<VolumeRAM>();
+        // Float32 keeps the density as is, up to the precision of a float
+        const double tolerance = step * orbital.maxDensity() + 1e-6 * orbital.maxDensity();
+        for (size_t z = 0; z < size; ++z) {
+            for (size_t y = 0; y < size; ++y) {
+                for (size_t x = 0; x < size; ++x) {
+                    const size3_t pos(x, y, z);
+                    const double density =
+                        orbital.density(HydrogenGenerator::idTOCartesian(pos, size));
+                    ASSERT_NEAR(density,
+                                result->dataMap_.mapFromDataToValue(ram->getAsDouble(pos)),
+                                tolerance)
+                        << format << " at " << x << ", " << y << ", " << z;
+                }
+            }
+        }
+    }
+}
+
+TEST(HydrogenTest, orbitalMatchesEval) {
+    const HydrogenOrbital orbital(3, 2, 0);
+    for (const auto& p : toTestEval) {
+        const auto expected = HydrogenGenerator::eval(p.first);
+        EXPECT_NEAR(expected, orbital.density(p.first), 0.001 * expected + 1e-15);
+        EXPECT_LE(orbital.density(p.first), orbital.maxDensity());
+    }
+}
+
+TEST(HydrogenTest, orbitalBoxBounds) {
+    for (const auto& [n, l, m] : {std::array<int, 3>{3, 2, 0}, {3, 2, 1}, {4, 3, -2}}) {
+        const HydrogenOrbital orbital(n, l, m);
+        size_t positive = 0;
+        for (int b = 0; b < 200; ++b) {
+            // Boxes of different sizes spread over the domain, some crossing the axes
+            const vec3 boxMin(std::fmod(b * 7.3f, 36.0f) - 18.0f,
+                              std::fmod(b * 3.1f, 36.0f) - 18.0f,
+                              std::fmod(b * 5.7f, 36.0f) - 18.0f);
+            const vec3 boxMax = boxMin + vec3(0.05f + (b % 5) * 0.7f);
+            const double minDensity = orbital.minDensity(boxMin, boxMax);
+            const double maxDensity = orbital.maxDensity(boxMin, boxMax);
+            if (minDensity > 0.0) ++positive;
+            for (int k = 0; k < 27; ++k) {
+                const vec3 t(k % 3 * 0.5f, k / 3 % 3 * 0.5f, k / 9 * 0.5f);
+                const double density = orbital.density(boxMin + t * (boxMax - boxMin));
+                EXPECT_LE(minDensity, density);
+                EXPECT_GE(maxDensity, density);
+            }
+        }
+        // The bound is not trivially zero
+        EXPECT_GT(positive, 50u);
+    }
+}
+
+TEST(HydrogenTest, orbitalGradient) {
+    for (const auto& [n, l, m] : {std::array<int, 3>{3, 2, 0}, {3, 2, -1}, {4, 3, 2}}) {
+        const HydrogenOrbital orbital(n, l, m);
+        for (int i = 0; i < 100; ++i) {
+            const vec3 p(std::fmod(i * 7.3f, 30.0f) - 15.0f, std::fmod(i * 3.1f, 30.0f) - 15.0f,
+                         std::fmod(i * 5.7f, 30.0f) - 15.0f);
+            dvec3 gradient;
+            EXPECT_EQ(orbital.density(p), orbital.density(p, gradient));
+
+            // Central differences over a step within the table resolution
+            const float h = 1e-3f;
+            dvec3 expected;
+            for (int k = 0; k < 3; ++k) {
+                vec3 d(0.0f);
+                d[k] = h;
+                expected[k] = (orbital.density(p + d) - orbital.density(p - d)) / (2.0 * h);
+            }
+            const double tolerance = 1e-2 * glm::length(expected) + 1e-12;
+            EXPECT_NEAR(expected.x, gradient.x, tolerance);
+            EXPECT_NEAR(expected.y, gradient.y, tolerance);
+            EXPECT_NEAR(expected.z, gradient.z, tolerance);
+
+            dvec3 mirrored;
+            orbital.density(vec3(-p.x, p.y, -p.z), mirrored);
+            EXPECT_EQ(dvec3(-gradient.x, gradient.y, -gradient.z), mirrored);
+        }
+    }
+}
+
+}  // namespace inviwo
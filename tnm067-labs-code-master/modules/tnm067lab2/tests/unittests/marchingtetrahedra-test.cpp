@@ -0,0 +1,394 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <gtest/gtest.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab2/processors/marchingtetrahedra.h>
+#include <modules/tnm067lab2/utils/datvolumeio.h>
+#include <modules/tnm067lab2/utils/meshfile.h>
+#include <inviwo/core/datastructures/geometry/basicmesh.h>
+#include <inviwo/core/datastructures/volume/volume.h>
+#include <inviwo/core/datastructures/volume/volumeram.h>
+#include <inviwo/core/ports/meshport.h>
+#include <inviwo/core/ports/volumeport.h>
+#include <inviwo/core/properties/boolproperty.h>
+#include <inviwo/core/properties/minmaxproperty.h>
+#include <inviwo/core/properties/optionproperty.h>
+#include <inviwo/core/properties/ordinalproperty.h>
+#include <inviwo/core/properties/stringproperty.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace inviwo {
+
+namespace {
+
+// The distance to a point off the center, so that the iso surfaces are spheres
+std::shared_ptr<Volume> makeSphereVolume() {
+    const size3_t dims(26, 24, 22);
+    auto volume = std::make_shared<Volume>(dims, DataFloat32::get());
+    volume->dataMap_.dataRange = dvec2(0.0, 1.0);
+    volume->dataMap_.valueRange = dvec2(0.0, 1.0);
+    auto data = static_cast<float*>(volume->getEditableRepresentation<VolumeRAM>()->getData());
+    for (size_t z = 0; z < dims.z; ++z) {
+        for (size_t y = 0; y < dims.y; ++y) {
+            for (size_t x = 0; x < dims.x; ++x) {
+                const vec3 p = vec3(x, y, z) / vec3(dims - size3_t(1));
+                *data++ = glm::length(p - vec3(0.45f, 0.5f, 0.55f));
+            }
+        }
+    }
+    return volume;
+}
+
+struct Surface {
+    mat4 modelMatrix;
+    std::vector<vec3> positions;
+    std::vector<vec3> normals;
+    // Triangles per iso value
+    std::vector<std::vector<std::uint32_t>> levels;
+};
+
+/**
+ * Copies a mesh with the basic vertex layout
+ */
+Surface toSurface(const Mesh& mesh) {
+    Surface surface;
+    surface.modelMatrix = mesh.getModelMatrix();
+    surface.positions = dynamic_cast<const Buffer<vec3>*>(
+                            mesh.findBuffer(BufferType::PositionAttrib).first)
+                            ->getRAMRepresentation()
+                            ->getDataContainer();
+    surface.normals = dynamic_cast<const Buffer<vec3>*>(
+                          mesh.findBuffer(BufferType::NormalAttrib).first)
+                          ->getRAMRepresentation()
+                          ->getDataContainer();
+    for (const auto& indices : mesh.getIndexBuffers()) {
+        surface.levels.push_back(indices.second->getRAMRepresentation()->getDataContainer());
+    }
+    return surface;
+}
+
+/**
+ * Runs MarchingTetrahedra on volume with the basic vertex layout, setup changes the properties
+ */
+Surface extract(std::shared_ptr<Volume> volume,
+                const std::function<void(MarchingTetrahedra&)>& setup) {
+    MarchingTetrahedra processor;
+    VolumeOutport source("source");
+    source.setData(volume);
+    processor.getInport("volume")->connectTo(&source);
+    MeshInport result("result");
+    result.connectTo(processor.getOutport("mesh"));
+    setup(processor);
+    processor.process();
+    return toSurface(*result.getData());
+}
+
+template <typename P>
+P& property(MarchingTetrahedra& processor, const std::string& identifier) {
+    return *dynamic_cast<P*>(processor.getPropertyByIdentifier(identifier, true));
+}
+
+/**
+ * Returns the positions of the corners of the triangles, three per triangle
+ */
+std::vector<vec3> triangleCorners(const Surface& surface, size_t level) {
+    std::vector<vec3> corners;
+    for (const auto index : surface.levels[level]) {
+        corners.push_back(surface.positions[index]);
+    }
+    return corners;
+}
+
+/**
+ * Returns the triangles of all levels as the coordinates of their corners, in sorted order
+ */
+std::vector<std::vector<float>> sortedTriangles(const std::vector<vec3>& positions,
+                                                const std::vector<std::uint32_t>& indices) {
+    std::vector<std::vector<float>> triangles;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        std::vector<float> triangle;
+        for (size_t k = 0; k < 3; ++k) {
+            const vec3& p = positions[indices[t + k]];
+            triangle.insert(triangle.end(), {p.x, p.y, p.z});
+        }
+        triangles.push_back(triangle);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+}  // namespace
+
+TEST(MarchingTetrahedraTest, closedAndConsistentlyOriented) {
+    const auto volume = makeSphereVolume();
+    for (const std::string method : {"tetrahedra", "fiveTetrahedra", "cubes"}) {
+        const auto surface = extract(volume, [&](MarchingTetrahedra& processor) {
+            property<FloatProperty>(processor, "isoValue").set(0.3f);
+            property<BaseOptionProperty>(processor, "method").setSelectedIdentifier(method);
+        });
+        ASSERT_EQ(1u, surface.levels.size());
+        const auto& indices = surface.levels.front();
+        EXPECT_GT(indices.size(), 300u) << method;
+
+        // Every edge is used once in each direction by the triangles next to it
+        std::map<std::pair<std::uint32_t, std::uint32_t>, int> edges;
+        size_t facingNormals = 0;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            for (size_t k = 0; k < 3; ++k) {
+                ++edges[{indices[t + k], indices[t + (k + 1) % 3]}];
+            }
+            // Triangles face towards lower values, like the vertex normals
+            const vec3 p0 = surface.positions[indices[t]];
+            const vec3 n = glm::cross(surface.positions[indices[t + 1]] - p0,
+                                      surface.positions[indices[t + 2]] - p0);
+            const vec3 normal = surface.normals[indices[t]] + surface.normals[indices[t + 1]] +
+                                surface.normals[indices[t + 2]];
+            if (glm::dot(n, normal) > 0.0f) ++facingNormals;
+        }
+        size_t unmatched = 0;
+        for (const auto& [edge, count] : edges) {
+            const auto reverse = edges.find({edge.second, edge.first});
+            if (count != 1 || reverse == edges.end() || reverse->second != 1) ++unmatched;
+        }
+        EXPECT_EQ(0u, unmatched) << method;
+        EXPECT_EQ(indices.size() / 3, facingNormals) << method;
+
+        for (const auto& p : surface.positions) {
+            EXPECT_NEAR(0.3f, glm::length(p - vec3(0.45f, 0.5f, 0.55f)), 0.01f) << method;
+        }
+    }
+}
+
+TEST(MarchingTetrahedraTest, independentOfThreads) {
+    const auto volume = makeSphereVolume();
+    for (const std::string method : {"tetrahedra", "fiveTetrahedra", "cubes"}) {
+        const auto extractWith = [&](size_t threads) {
+            return extract(volume, [&](MarchingTetrahedra& processor) {
+                property<FloatProperty>(processor, "isoValue").set(0.3f);
+                property<BaseOptionProperty>(processor, "method").setSelectedIdentifier(method);
+                property<IntSizeTProperty>(processor, "threads").set(threads);
+            });
+        };
+        const auto single = extractWith(1);
+        for (const size_t threads : {2, 5, 21}) {
+            const auto threaded = extractWith(threads);
+            EXPECT_TRUE(single.positions == threaded.positions) << method << " " << threads;
+            EXPECT_TRUE(single.normals == threaded.normals) << method << " " << threads;
+            EXPECT_TRUE(single.levels == threaded.levels) << method << " " << threads;
+        }
+    }
+}
+
+TEST(MarchingTetrahedraTest, isoValueListMatchesSeparateExtractions) {
+    const auto volume = makeSphereVolume();
+    const std::vector<float> isos{0.2f, 0.3f, 0.37f};
+    const auto combined = extract(volume, [](MarchingTetrahedra& processor) {
+        property<StringProperty>(processor, "isoValueList").set("0.2, 0.3 0.37");
+        property<IntSizeTProperty>(processor, "threads").set(3);
+    });
+    ASSERT_EQ(isos.size(), combined.levels.size());
+
+    for (size_t level = 0; level < isos.size(); ++level) {
+        const auto separate = extract(volume, [&](MarchingTetrahedra& processor) {
+            property<FloatProperty>(processor, "isoValue").set(isos[level]);
+            property<IntSizeTProperty>(processor, "threads").set(3);
+        });
+        ASSERT_EQ(1u, separate.levels.size());
+        EXPECT_FALSE(separate.levels.front().empty());
+        EXPECT_TRUE(triangleCorners(separate, 0) == triangleCorners(combined, level))
+            << "iso " << isos[level];
+    }
+}
+
+TEST(MarchingTetrahedraTest, levelsSharingEdgesMatchSeparateExtractions) {
+    // Iso values this close cross mostly the same edges, which keep a vertex per level
+    const auto volume = makeSphereVolume();
+    const std::vector<float> isos{0.3f, 0.302f, 0.305f};
+    for (const size_t threads : {1, 4, 7}) {
+        const auto combined = extract(volume, [&](MarchingTetrahedra& processor) {
+            property<StringProperty>(processor, "isoValueList").set("0.3 0.302 0.305");
+            property<BaseOptionProperty>(processor, "method").setSelectedIdentifier("cubes");
+            property<IntSizeTProperty>(processor, "threads").set(threads);
+        });
+        ASSERT_EQ(isos.size(), combined.levels.size());
+
+        size_t vertices = 0;
+        for (size_t level = 0; level < isos.size(); ++level) {
+            const auto separate = extract(volume, [&](MarchingTetrahedra& processor) {
+                property<FloatProperty>(processor, "isoValue").set(isos[level]);
+                property<BaseOptionProperty>(processor, "method").setSelectedIdentifier("cubes");
+                property<IntSizeTProperty>(processor, "threads").set(threads);
+            });
+            EXPECT_TRUE(triangleCorners(separate, 0) == triangleCorners(combined, level))
+                << "iso " << isos[level] << ", threads " << threads;
+            // The vertices of a level are welded like in a separate extraction
+            const std::set<std::uint32_t> used(combined.levels[level].begin(),
+                                               combined.levels[level].end());
+            EXPECT_EQ(separate.positions.size(), used.size())
+                << "iso " << isos[level] << ", threads " << threads;
+            vertices += separate.positions.size();
+        }
+        EXPECT_EQ(vertices, combined.positions.size()) << "threads " << threads;
+    }
+}
+
+TEST(MarchingTetrahedraTest, extractToFileMatchesExtractionInMemory) {
+    const auto volume = makeSphereVolume();
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto dat = dir / "tnm067lab2-extract-test.dat";
+    const auto meshFile = dir / "tnm067lab2-extract-test.mesh";
+    util::writeDatVolume(*volume, dat.string());
+
+    const auto inMemory = extract(volume, [](MarchingTetrahedra& processor) {
+        property<StringProperty>(processor, "isoValueList").set("0.2 0.3");
+    });
+    std::vector<std::uint32_t> indices;
+    for (const auto& level : inMemory.levels) {
+        indices.insert(indices.end(), level.begin(), level.end());
+    }
+
+    std::atomic<bool> cancelled{false};
+    float progress = 0.0f;
+    const auto triangles = MarchingTetrahedra::extractToFile(
+        dat.string(), {0.2f, 0.3f}, MarchingTetrahedra::Method::Tetrahedra, meshFile.string(),
+        cancelled, [&](float fraction) { progress = fraction; });
+    EXPECT_EQ(indices.size() / 3, triangles);
+    EXPECT_FLOAT_EQ(1.0f, progress);
+
+    const auto mesh = util::readMeshFile(meshFile.string());
+    std::filesystem::remove(meshFile);
+    const auto& positions = mesh->getVertices()->getRAMRepresentation()->getDataContainer();
+    EXPECT_EQ(inMemory.positions.size(), positions.size());
+    EXPECT_TRUE(sortedTriangles(inMemory.positions, indices) ==
+                sortedTriangles(positions,
+                                mesh->getIndices(0)->getRAMRepresentation()->getDataContainer()));
+
+    // A cancelled extraction leaves no mesh file behind
+    cancelled = true;
+    EXPECT_THROW(MarchingTetrahedra::extractToFile(dat.string(), {0.2f, 0.3f},
+                                                   MarchingTetrahedra::Method::Tetrahedra,
+                                                   meshFile.string(), cancelled),
+                 Exception);
+    EXPECT_FALSE(std::filesystem::exists(meshFile));
+
+    std::filesystem::remove(dat);
+    std::filesystem::remove(dir / "tnm067lab2-extract-test.raw");
+}
+
+TEST(MarchingTetrahedraTest, incrementalMatchesFullExtractionAfterLocalEdit) {
+    const auto volume = makeSphereVolume();
+    auto data = static_cast<float*>(volume->getEditableRepresentation<VolumeRAM>()->getData());
+    const size3_t dims = volume->getDimensions();
+    const auto setup = [](const std::string& method) {
+        return [method](MarchingTetrahedra& processor) {
+            property<StringProperty>(processor, "isoValueList").set("0.3 0.35");
+            property<BaseOptionProperty>(processor, "method").setSelectedIdentifier(method);
+            property<IntSizeTProperty>(processor, "threads").set(3);
+        };
+    };
+
+    for (const std::string method : {"tetrahedra", "fiveTetrahedra", "cubes"}) {
+        MarchingTetrahedra processor;
+        VolumeOutport source("source");
+        source.setData(volume);
+        processor.getInport("volume")->connectTo(&source);
+        MeshInport result("result");
+        result.connectTo(processor.getOutport("mesh"));
+        setup(method)(processor);
+        property<BoolProperty>(processor, "reuseBlocks").set(true);
+        processor.process();
+
+        // Dents in the spheres, then the first one filled in again. They start one voxel past
+        // the corners of blocks, so the gradients reach into blocks whose voxels are unchanged
+        const std::vector<std::pair<size3_t, float>> edits{
+            {size3_t(17, 9, 9), 0.2f}, {size3_t(12, 17, 14), 0.5f}, {size3_t(17, 9, 9), 0.3f}};
+        for (const auto& [corner, value] : edits) {
+            for (size_t z = corner.z; z < corner.z + 3; ++z) {
+                for (size_t y = corner.y; y < corner.y + 3; ++y) {
+                    for (size_t x = corner.x; x < corner.x + 3; ++x) {
+                        data[x + dims.x * (y + dims.y * z)] = value;
+                    }
+                }
+            }
+            processor.getInport("volume")->callOnChangeIfChanged();
+            processor.process();
+
+            const auto incremental = toSurface(*result.getData());
+            const auto full = extract(volume, setup(method));
+            ASSERT_EQ(full.levels.size(), incremental.levels.size());
+            for (size_t level = 0; level < full.levels.size(); ++level) {
+                EXPECT_TRUE(sortedTriangles(full.positions, full.levels[level]) ==
+                            sortedTriangles(incremental.positions, incremental.levels[level]))
+                    << method << ", level " << level;
+                EXPECT_TRUE(sortedTriangles(full.normals, full.levels[level]) ==
+                            sortedTriangles(incremental.normals, incremental.levels[level]))
+                    << method << ", level " << level;
+            }
+            // The vertices of neighbouring blocks are welded like in a full extraction
+            std::set<std::uint32_t> used;
+            for (const auto& level : incremental.levels) {
+                used.insert(level.begin(), level.end());
+            }
+            EXPECT_EQ(full.positions.size(), used.size()) << method;
+        }
+    }
+}
+
+TEST(MarchingTetrahedraTest, regionOfInterestIsPartOfTheFullSurface) {
+    const auto volume = makeSphereVolume();
+    const auto full = extract(volume, [](MarchingTetrahedra& processor) {
+        property<FloatProperty>(processor, "isoValue").set(0.3f);
+    });
+    const auto region = extract(volume, [](MarchingTetrahedra& processor) {
+        property<FloatProperty>(processor, "isoValue").set(0.3f);
+        property<FloatMinMaxProperty>(processor, "roiX").set(vec2(0.2f, 0.7f));
+        property<FloatMinMaxProperty>(processor, "roiY").set(vec2(0.3f, 1.0f));
+        property<FloatMinMaxProperty>(processor, "roiZ").set(vec2(0.0f, 0.6f));
+    });
+    ASSERT_FALSE(region.levels.front().empty());
+    EXPECT_LT(region.levels.front().size(), full.levels.front().size());
+
+    // The vertices of the region are matched to the full surface in the space of the volume
+    const auto toVolume = [](const Surface& surface, const vec3& p) {
+        return vec3(surface.modelMatrix * vec4(p, 1.0f));
+    };
+    std::vector<std::uint32_t> matches;
+    for (const auto& p : region.positions) {
+        const vec3 q = toVolume(region, p);
+        std::uint32_t match = std::numeric_limits<std::uint32_t>::max();
+        for (size_t i = 0; i < full.positions.size(); ++i) {
+            if (glm::length(toVolume(full, full.positions[i]) - q) < 1e-5f) {
+                match = static_cast<std::uint32_t>(i);
+                break;
+            }
+        }
+        ASSERT_NE(std::numeric_limits<std::uint32_t>::max(), match);
+        matches.push_back(match);
+    }
+
+    std::set<std::vector<std::uint32_t>> triangles;
+    const auto& indices = full.levels.front();
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        triangles.insert({indices[t], indices[t + 1], indices[t + 2]});
+    }
+    const auto& regionIndices = region.levels.front();
+    for (size_t t = 0; t + 2 < regionIndices.size(); t += 3) {
+        const std::vector<std::uint32_t> triangle{matches[regionIndices[t]],
+                                                  matches[regionIndices[t + 1]],
+                                                  matches[regionIndices[t + 2]]};
+        EXPECT_EQ(1u, triangles.count(triangle)) << "triangle " << t / 3;
+    }
+}
+
+}  // namespace inviwo
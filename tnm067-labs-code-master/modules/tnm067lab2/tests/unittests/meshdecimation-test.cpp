@@ -0,0 +1,118 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <gtest/gtest.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab2/utils/meshdecimation.h>
+#include <modules/tnm067lab2/utils/normalencoding.h>
+#include <inviwo/core/datastructures/geometry/basicmesh.h>
+#include <inviwo/core/datastructures/buffer/bufferram.h>
+#include <inviwo/core/util/glm.h>
+
+namespace inviwo {
+
+namespace {
+
+// A square in the xy-plane of n x n quads, facing +z
+std::shared_ptr<BasicMesh> makeGrid(std::uint32_t n) {
+    auto mesh = std::make_shared<BasicMesh>();
+    std::vector<BasicMesh::Vertex> vertices;
+    for (std::uint32_t y = 0; y <= n; ++y) {
+        for (std::uint32_t x = 0; x <= n; ++x) {
+            const vec3 pos(static_cast<float>(x) / n, static_cast<float>(y) / n, 0.0f);
+            vertices.push_back({pos, vec3(0, 0, 1), pos, vec4(1.0f)});
+        }
+    }
+    mesh->addVertices(vertices);
+    auto indices = mesh->addIndexBuffer(DrawType::Triangles, ConnectivityType::None);
+    for (std::uint32_t y = 0; y < n; ++y) {
+        for (std::uint32_t x = 0; x < n; ++x) {
+            const std::uint32_t i = x + y * (n + 1);
+            indices->add({i, i + 1, i + n + 2, i, i + n + 2, i + n + 1});
+        }
+    }
+    return mesh;
+}
+
+}  // namespace
+
+TEST(MeshDecimationTest, flatGridKeepsShapeAndOrientation) {
+    const auto grid = makeGrid(24);
+    const size_t before = grid->getIndices(0)->getSize() / 3;
+
+    for (size_t partitions : {1, 4}) {
+        const auto mesh = util::decimateMesh(*grid, 0.1f, 0.0f, partitions);
+        const auto& positions = mesh->getVertices()->getRAMRepresentation()->getDataContainer();
+        const auto& indices = mesh->getIndices(0)->getRAMRepresentation()->getDataContainer();
+        EXPECT_LT(indices.size() / 3, before / 2);
+
+        float area = 0.0f;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            const vec3 n = glm::cross(positions[indices[i + 1]] - positions[indices[i]],
+                                      positions[indices[i + 2]] - positions[indices[i]]);
+            EXPECT_GT(n.z, 0.0f);
+            area += 0.5f * n.z;
+        }
+        EXPECT_NEAR(1.0f, area, 1e-4f);
+        for (const auto& p : positions) {
+            EXPECT_FLOAT_EQ(0.0f, p.z);
+        }
+    }
+}
+
+TEST(MeshDecimationTest, quantizedPositionsAreDequantized) {
+    // The grid in the quantized layout of MarchingTetrahedra, placed at a scale of 2
+    const auto grid = makeGrid(24);
+    std::vector<glm::u16vec3> positions;
+    std::vector<glm::i16vec2> normals;
+    for (const auto& p : grid->getVertices()->getRAMRepresentation()->getDataContainer()) {
+        positions.emplace_back(glm::round(p * 65535.0f));
+        normals.push_back(util::encodeOctahedral(vec3(0, 0, 1)));
+    }
+    Mesh quantized(DrawType::Triangles, ConnectivityType::None);
+    quantized.setModelMatrix(glm::scale(mat4(1.0f), vec3(2.0f / 65535.0f)));
+    quantized.addBuffer(BufferType::PositionAttrib, util::makeBuffer(std::move(positions)));
+    quantized.addBuffer(BufferType::NormalAttrib, util::makeBuffer(std::move(normals)));
+    quantized.addIndices(Mesh::MeshInfo(DrawType::Triangles, ConnectivityType::None),
+                         util::makeIndexBuffer(std::vector<std::uint32_t>(
+                             grid->getIndices(0)->getRAMRepresentation()->getDataContainer())));
+
+    const auto mesh = util::decimateMesh(quantized, 0.1f, 0.0f, 2);
+    EXPECT_LT(mesh->getIndices(0)->getSize(), grid->getIndices(0)->getSize() / 2);
+    const auto& vertices = mesh->getVertices()->getRAMRepresentation()->getDataContainer();
+    const auto& vertexNormals = mesh->getNormals()->getRAMRepresentation()->getDataContainer();
+    for (size_t v = 0; v < vertices.size(); ++v) {
+        // Back in the unit cube, and in the same place through the model matrix
+        const vec3& p = vertices[v];
+        for (int k = 0; k < 3; ++k) {
+            EXPECT_GE(p[k], 0.0f);
+            EXPECT_LE(p[k], 1.0f);
+        }
+        const vec3 placed = vec3(mesh->getModelMatrix() * vec4(p, 1.0f));
+        EXPECT_NEAR(2.0f * p.x, placed.x, 1e-5f);
+        EXPECT_NEAR(2.0f * p.y, placed.y, 1e-5f);
+        EXPECT_NEAR(1.0f, vertexNormals[v].z, 1e-4f);
+    }
+}
+
+TEST(MeshDecimationTest, maxErrorKeepsFold) {
+    // Folding the grid along x = 0.5 makes every collapse across the fold cost more than 0
+    auto grid = makeGrid(16);
+    std::vector<BasicMesh::Vertex> vertices;
+    for (auto p : grid->getVertices()->getRAMRepresentation()->getDataContainer()) {
+        p.z = 0.5f * std::abs(p.x - 0.5f);
+        vertices.push_back({p, vec3(0, 0, 1), p, vec4(1.0f)});
+    }
+    auto folded = std::make_shared<BasicMesh>();
+    folded->addVertices(vertices);
+    folded->addIndexBuffer(DrawType::Triangles, ConnectivityType::None)->getDataContainer() =
+        grid->getIndices(0)->getRAMRepresentation()->getDataContainer();
+
+    const auto mesh = util::decimateMesh(*folded, 0.01f, 1e-4f, 2);
+    const auto& positions = mesh->getVertices()->getRAMRepresentation()->getDataContainer();
+    for (const auto& p : positions) {
+        EXPECT_NEAR(0.5f * std::abs(p.x - 0.5f), p.z, 1e-4f);
+    }
+}
+
+}  // namespace inviwo
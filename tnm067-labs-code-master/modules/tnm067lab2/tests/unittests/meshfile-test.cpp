@@ -0,0 +1,49 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <gtest/gtest.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab2/utils/meshfile.h>
+#include <inviwo/core/datastructures/geometry/basicmesh.h>
+
+#include <filesystem>
+
+namespace inviwo {
+
+TEST(MeshFileTest, chunksRoundTrip) {
+    const auto path = std::filesystem::temp_directory_path() / "tnm067lab2-meshfile-test.mesh";
+    const mat4 model(2.0f);
+    {
+        MeshFileWriter writer(path.string(), model, mat4(1.0f));
+        writer.addVertices({vec3(0, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0)},
+                           {vec3(0, 0, 1), vec3(0, 0, 1), vec3(0, 0, 1)});
+        writer.addTriangles({0, 1, 2});
+        writer.addVertices({vec3(1, 1, 0)}, {vec3(0, 0, -1)});
+        writer.addTriangles({1, 3, 2});
+        writer.close();
+        EXPECT_EQ(4u, writer.getVertexCount());
+        EXPECT_EQ(2u, writer.getTriangleCount());
+    }
+
+    const auto mesh = util::readMeshFile(path.string());
+    std::filesystem::remove(path);
+
+    EXPECT_EQ(model, mesh->getModelMatrix());
+    const auto& positions = mesh->getVertices()->getRAMRepresentation()->getDataContainer();
+    ASSERT_EQ(4u, positions.size());
+    EXPECT_EQ(vec3(1, 1, 0), positions[3]);
+    const auto& indices = mesh->getIndices(0)->getRAMRepresentation()->getDataContainer();
+    EXPECT_EQ((std::vector<std::uint32_t>{0, 1, 2, 1, 3, 2}), indices);
+}
+
+TEST(MeshFileTest, unclosedWriterLeavesNoFile) {
+    const auto path = std::filesystem::temp_directory_path() / "tnm067lab2-unclosed-test.mesh";
+    {
+        MeshFileWriter writer(path.string(), mat4(1.0f), mat4(1.0f));
+        writer.addVertices({vec3(0.0f)}, {vec3(0.0f)});
+    }
+    EXPECT_FALSE(std::filesystem::exists(path));
+    EXPECT_THROW(util::readMeshFile(path.string()), Exception);
+}
+
+}  // namespace inviwo
@@ -0,0 +1,91 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <gtest/gtest.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab2/utils/minmaxgrid.h>
+#include <modules/tnm067lab2/utils/intervaltree.h>
+#include <inviwo/core/datastructures/volume/volumeramprecision.h>
+
+#include <algorithm>
+
+namespace inviwo {
+
+TEST(MinMaxGridTest, blocksCoverTheVoxelsOfTheirCells) {
+    // 20 voxels give 19 cells, i.e. blocks of 8, 8 and 3 cells along each axis
+    const size3_t dims(20, 20, 20);
+    VolumeRAMPrecision<float> volume(dims);
+    float* data = volume.getDataTyped();
+    for (size_t z = 0; z < dims.z; ++z) {
+        for (size_t y = 0; y < dims.y; ++y) {
+            for (size_t x = 0; x < dims.x; ++x) {
+                *data++ = static_cast<float>(x);
+            }
+        }
+    }
+
+    MinMaxGrid grid(volume);
+    EXPECT_EQ(size3_t(3), grid.getDimensions());
+    EXPECT_EQ(vec2(0.0f, 8.0f), grid.getRange(size3_t(0, 1, 2)));
+    EXPECT_EQ(vec2(8.0f, 16.0f), grid.getRange(size3_t(1, 0, 0)));
+    EXPECT_EQ(vec2(16.0f, 19.0f), grid.getRange(size3_t(2, 2, 1)));
+
+    EXPECT_TRUE(grid.isActive(size3_t(1, 0, 0), 16.0f));
+    EXPECT_FALSE(grid.isActive(size3_t(1, 0, 0), 8.0f));
+    EXPECT_FALSE(grid.isActive(size3_t(1, 0, 0), 16.5f));
+}
+
+TEST(MinMaxGridTest, updateFindsChangedBlocks) {
+    const size3_t dims(20, 20, 20);
+    VolumeRAMPrecision<float> volume(dims);
+    float* data = volume.getDataTyped();
+    std::fill(data, data + dims.x * dims.y * dims.z, 1.0f);
+
+    MinMaxGrid grid(volume);
+    EXPECT_TRUE(grid.update(volume).empty());
+
+    // Voxel (8, 3, 12) lies on the border between blocks (0, 0, 1) and (1, 0, 1)
+    data[8 + dims.x * (3 + dims.y * 12)] = 2.0f;
+    const std::vector<size_t> expected{9, 10};
+    EXPECT_EQ(expected, grid.update(volume));
+    EXPECT_EQ(vec2(1.0f, 2.0f), grid.getRange(size3_t(1, 0, 1)));
+    EXPECT_EQ(expected, grid.getActiveBlocks(1.5f));
+
+    // A new value with the same range is found by the hashes
+    data[9 + dims.x * (3 + dims.y * 12)] = 1.5f;
+    EXPECT_EQ(std::vector<size_t>{10}, grid.update(volume));
+
+    VolumeRAMPrecision<float> larger(size3_t(28, 20, 20));
+    EXPECT_EQ(size_t{36}, grid.update(larger).size());
+    EXPECT_EQ(size3_t(4, 3, 3), grid.getDimensions());
+
+    // Without hashes every block counts as changed
+    MinMaxGrid untracked(volume, false);
+    EXPECT_EQ(size_t{27}, untracked.update(volume).size());
+    EXPECT_EQ(vec2(1.0f, 2.0f), untracked.getRange(size3_t(1, 0, 1)));
+}
+
+TEST(MinMaxGridTest, intervalTreeMatchesLinearScan) {
+    std::vector<vec2> intervals;
+    for (size_t i = 0; i < 500; ++i) {
+        const float a = static_cast<float>((i * 37) % 101);
+        const float b = static_cast<float>((i * 53) % 97);
+        intervals.emplace_back(std::min(a, b), std::max(a, b));
+    }
+    const IntervalTree tree(intervals);
+
+    for (float value = -1.0f; value <= 102.0f; value += 0.5f) {
+        std::vector<size_t> expected;
+        for (size_t i = 0; i < intervals.size(); ++i) {
+            if (intervals[i].x < value && value <= intervals[i].y) {
+                expected.push_back(i);
+            }
+        }
+        std::vector<size_t> result;
+        tree.query(value, result);
+        std::sort(result.begin(), result.end());
+        EXPECT_EQ(expected, result) << "value " << value;
+    }
+}
+
+}  // namespace inviwo
@@ -0,0 +1,31 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <gtest/gtest.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab2/utils/normalencoding.h>
+
+#include <cmath>
+
+namespace inviwo {
+
+TEST(NormalEncodingTest, octahedralRoundTrip) {
+    float maxAngle = 0.0f;
+    for (int i = 0; i < 64; ++i) {
+        for (int j = 0; j < 32; ++j) {
+            const float phi = static_cast<float>(i) / 64.0f * 6.2831853f;
+            const float theta = (static_cast<float>(j) + 0.5f) / 32.0f * 3.1415927f;
+            const vec3 normal(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi),
+                              std::cos(theta));
+            const vec3 decoded = util::decodeOctahedral(util::encodeOctahedral(normal));
+            // the length of the cross product is accurate for small angles, unlike acos
+            maxAngle = std::max(maxAngle, std::asin(glm::length(glm::cross(normal, decoded))));
+        }
+    }
+    EXPECT_LT(maxAngle, 1e-4f);
+
+    const vec3 down(0.0f, 0.0f, -1.0f);
+    EXPECT_EQ(down, util::decodeOctahedral(util::encodeOctahedral(down)));
+}
+
+}  // namespace inviwo
@@ -0,0 +1,52 @@
+#include <warn/push>
+#include <warn/ignore/all>
+#include <gtest/gtest.h>
+#include <warn/pop>
+
+#include <modules/tnm067lab2/utils/orbitalsurface.h>
+#include <modules/tnm067lab2/utils/hydrogenorbital.h>
+#include <inviwo/core/datastructures/geometry/basicmesh.h>
+
+#include <algorithm>
+#include <map>
+
+namespace inviwo {
+
+TEST(OrbitalSurfaceTest, closedAndIndependentOfThreads) {
+    const HydrogenOrbital orbital(3, 2, 1);
+    const double iso = 0.05 * orbital.maxDensity();
+    const auto mesh = util::extractOrbitalSurface(orbital, iso, 5, 1);
+    const auto& positions = mesh->getVertices()->getRAMRepresentation()->getDataContainer();
+    const auto& indices = mesh->getIndices(0)->getRAMRepresentation()->getDataContainer();
+    ASSERT_GT(indices.size(), 0u);
+
+    // Every edge is shared by two triangles that traverse it in opposite directions
+    std::map<std::pair<std::uint32_t, std::uint32_t>, int> edges;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        for (size_t k = 0; k < 3; ++k) {
+            ++edges[{indices[i + k], indices[i + (k + 1) % 3]}];
+        }
+    }
+    for (const auto& [edge, count] : edges) {
+        EXPECT_EQ(1, count);
+        EXPECT_EQ(1u, edges.count({edge.second, edge.first}));
+    }
+    for (const auto& p : positions) {
+        for (int i = 0; i < 3; ++i) {
+            EXPECT_GE(p[i], 0.0f);
+            EXPECT_LE(p[i], 1.0f);
+        }
+    }
+
+    const auto threaded = util::extractOrbitalSurface(orbital, iso, 5, 4);
+    EXPECT_EQ(positions, threaded->getVertices()->getRAMRepresentation()->getDataContainer());
+    EXPECT_EQ(indices, threaded->getIndices(0)->getRAMRepresentation()->getDataContainer());
+}
+
+TEST(OrbitalSurfaceTest, invalidDepthThrows) {
+    const HydrogenOrbital orbital(2, 1, 0);
+    EXPECT_THROW(util::extractOrbitalSurface(orbital, 0.1 * orbital.maxDensity(), 2, 1),
+                 Exception);
+}
+
+}  // namespace inviwo
@@ -0,0 +1,284 @@
+#ifdef _MSC_VER
+#pragma comment(linker, "/SUBSYSTEM:CONSOLE")
+#pragma comment(lib, "psapi.lib")
+#endif
+
+#include <inviwo/core/common/inviwoapplication.h>
+#include <inviwo/core/util/logcentral.h>
+#include <inviwo/core/util/consolelogger.h>
+#include <inviwo/core/ports/volumeport.h>
+#include <inviwo/core/ports/meshport.h>
+#include <inviwo/core/properties/ordinalproperty.h>
+#include <inviwo/core/properties/optionproperty.h>
+#include <inviwo/core/properties/stringproperty.h>
+#include <inviwo/core/datastructures/geometry/mesh.h>
+#include <modules/tnm067lab2/processors/hydrogengenerator.h>
+#include <modules/tnm067lab2/processors/marchingtetrahedra.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+/**
+ * Extraction benchmark for MarchingTetrahedra. Generates hydrogen volumes with HydrogenGenerator,
+ * extracts iso surfaces at fractions of the largest density and writes the timings as JSON.
+ * The hit rate of the edge cache is only reported when the module is built with
+ * IVW_TNM067LAB2_PROFILING, whose timers add to the extraction time.
+ *
+ * Usage: tnm067lab2-benchmark [--sizes 64,128,256,512] [--isos 0.01,0.05,0.2] [--threads n]
+ *                             [--method tetrahedra|fiveTetrahedra|cubes] [--repeat n]
+ *                             [--output file.json]
+ */
+
+namespace {
+
+using namespace inviwo;
+
+struct Options {
+    std::vector<size_t> sizes{64, 128, 256, 512};
+    std::vector<double> isos{0.01, 0.05, 0.2};
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string method = "tetrahedra";
+    size_t repeat = 3;
+    std::string output;
+};
+
+template <typename T>
+std::vector<T> parseList(const std::string& list) {
+    std::vector<T> values;
+    std::istringstream stream(list);
+    std::string token;
+    while (std::getline(stream, token, ',')) {
+        std::istringstream value(token);
+        T v{};
+        if (!(value >> v)) throw std::invalid_argument("invalid value '" + token + "'");
+        values.push_back(v);
+    }
+    return values;
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+        const std::string value = argv[++i];
+        if (arg == "--sizes") {
+            options.sizes = parseList<size_t>(value);
+        } else if (arg == "--isos") {
+            options.isos = parseList<double>(value);
+        } else if (arg == "--threads") {
+            options.threads = std::stoul(value);
+        } else if (arg == "--method") {
+            options.method = value;
+        } else if (arg == "--repeat") {
+            options.repeat = std::max(size_t{1}, size_t{std::stoul(value)});
+        } else if (arg == "--output") {
+            options.output = value;
+        } else {
+            throw std::invalid_argument("unknown argument " + arg);
+        }
+    }
+    return options;
+}
+
+/**
+ * Resident set of the process in bytes
+ */
+size_t currentMemory() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.WorkingSetSize;
+#elif defined(__APPLE__)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info),
+                  &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return static_cast<size_t>(info.resident_size);
+#else
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+/**
+ * Samples the resident set every millisecond from construction to stop. The peak of the process
+ * so far would include the volumes and meshes of earlier runs.
+ */
+class MemorySampler {
+public:
+    MemorySampler()
+        : baseline_{currentMemory()}, peak_{baseline_}, running_{true}, thread_{[this]() {
+              while (running_) {
+                  peak_ = std::max(peak_, currentMemory());
+                  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+              }
+          }} {}
+    ~MemorySampler() { stop(); }
+    MemorySampler(const MemorySampler&) = delete;
+    MemorySampler& operator=(const MemorySampler&) = delete;
+
+    /**
+     * Stops sampling and returns the largest resident set seen
+     */
+    size_t stop() {
+        if (thread_.joinable()) {
+            running_ = false;
+            thread_.join();
+            peak_ = std::max(peak_, currentMemory());
+        }
+        return peak_;
+    }
+    size_t baseline() const { return baseline_; }
+
+private:
+    size_t baseline_;
+    size_t peak_;  // only touched by thread_ until it is joined
+    std::atomic<bool> running_;
+    std::thread thread_;
+};
+
+template <typename P>
+P& property(Processor& processor, const std::string& identifier) {
+    auto p = dynamic_cast<P*>(processor.getPropertyByIdentifier(identifier, true));
+    if (!p) throw std::invalid_argument("no property " + identifier);
+    return *p;
+}
+
+template <typename F>
+double seconds(F f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    using namespace inviwo;
+
+    LogCentral::init();
+    auto logger = std::make_shared<ConsoleLogger>();
+    LogCentral::getPtr()->setVerbosity(LogVerbosity::Error);
+    LogCentral::getPtr()->registerLogger(logger);
+    InviwoApplication app("Inviwo-Benchmark-TNM067Lab2");
+
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ostringstream json;
+    try {
+        json << "{\n  \"method\": \"" << options.method << "\",\n  \"threads\": " << options.threads
+             << ",\n  \"repeat\": " << options.repeat << ",\n  \"runs\": [";
+
+        bool first = true;
+        for (const size_t size : options.sizes) {
+            // A new extractor per volume, its block ranges are built for the first volume it sees.
+            // The generator only fills connected outports, so the ports are connected first.
+            HydrogenGenerator generator;
+            MarchingTetrahedra extractor;
+            auto& volumePort = *dynamic_cast<VolumeOutport*>(generator.getOutport("volume"));
+            auto& meshPort = *dynamic_cast<MeshOutport*>(extractor.getOutport("mesh"));
+            extractor.getInport("volume")->connectTo(&volumePort);
+
+            property<IntSizeTProperty>(generator, "size_").set(size);
+            property<BaseOptionProperty>(extractor, "method").setSelectedIdentifier(options.method);
+            property<IntSizeTProperty>(extractor, "threads").set(options.threads);
+
+            const double generation = seconds([&]() { generator.process(); });
+            const double maxValue = volumePort.getData()->dataMap_.valueRange.y;
+
+            for (const double iso : options.isos) {
+                const double isoValue = iso * maxValue;
+                std::ostringstream isoString;
+                isoString.precision(9);
+                isoString << isoValue;
+                property<StringProperty>(extractor, "isoValueList").set(isoString.str());
+
+                std::vector<double> times;
+                MemorySampler memory;
+                for (size_t r = 0; r < options.repeat; ++r) {
+                    times.push_back(seconds([&]() { extractor.process(); }));
+                }
+                const size_t peakMemory = memory.stop();
+                std::sort(times.begin(), times.end());
+                const double time = times[times.size() / 2];
+
+                const auto mesh = meshPort.getData();
+                size_t triangles = 0;
+                for (const auto& indexBuffer : mesh->getIndexBuffers()) {
+                    triangles += indexBuffer.second->getSize() / 3;
+                }
+                const auto positions = mesh->findBuffer(BufferType::PositionAttrib).first;
+                const size_t vertices = positions ? positions->getSize() : 0;
+                const double cells = static_cast<double>(size - 1) * (size - 1) * (size - 1);
+                // Share of the triangle corners that reuse a vertex of another corner, from the
+                // output, e.g. 5/6 for a closed surface with six triangles around each vertex
+                const double vertexSharing =
+                    triangles > 0 ? 1.0 - static_cast<double>(vertices) / (3.0 * triangles) : 0.0;
+
+                json << (first ? "\n" : ",\n") << "    {\"size\": " << size << ", \"iso\": " << iso
+                     << ", \"isoValue\": " << isoValue << ", \"generationSeconds\": " << generation
+                     << ", \"seconds\": " << time << ", \"cellsPerSecond\": " << cells / time
+                     << ", \"triangles\": " << triangles << ", \"trianglesPerSecond\": "
+                     << triangles / time << ", \"vertices\": " << vertices
+                     << ", \"vertexSharing\": " << vertexSharing;
+#ifdef IVW_TNM067LAB2_PROFILING
+                // Counted by the edge cache of the last run
+                const double hits = static_cast<double>(
+                    property<IntSizeTProperty>(extractor, "edgeHits").get());
+                const double misses = static_cast<double>(
+                    property<IntSizeTProperty>(extractor, "edgeMisses").get());
+                json << ", \"edgeCacheHitRate\": "
+                     << (hits + misses > 0.0 ? hits / (hits + misses) : 0.0);
+#endif
+                json << ", \"baselineMemoryBytes\": " << memory.baseline()
+                     << ", \"peakMemoryBytes\": " << peakMemory << "}";
+                first = false;
+            }
+        }
+        json << "\n  ]\n}\n";
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (options.output.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream file(options.output);
+        file << json.str();
+        if (!file) {
+            std::cerr << "Could not write " << options.output << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
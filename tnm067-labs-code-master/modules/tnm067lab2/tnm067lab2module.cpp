@@ -1,6 +1,8 @@
 #include <modules/tnm067lab2/tnm067lab2module.h>
 #include <modules/tnm067lab2/processors/hydrogengenerator.h>
+#include <modules/tnm067lab2/processors/hydrogenisosurface.h>
 #include <modules/tnm067lab2/processors/marchingtetrahedra.h>
+#include <modules/tnm067lab2/processors/meshdecimation.h>
 
 namespace inviwo {
 
@@ -11,6 +13,8 @@ TNM067Lab2Module::TNM067Lab2Module(InviwoApplication* app) : InviwoModule(app, "
     // Register objects that can be shared with the rest of inviwo here:
     // Processors
     registerProcessor<HydrogenGenerator>();
-    registerProcessor<MarchingTetrahedra>();}
+    registerProcessor<HydrogenIsosurface>();
+    registerProcessor<MarchingTetrahedra>();
+    registerProcessor<MeshDecimation>();}
 
 }  // namespace inviwo
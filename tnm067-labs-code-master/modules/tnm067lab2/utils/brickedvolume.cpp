@@ -0,0 +1,86 @@
+#include <modules/tnm067lab2/utils/brickedvolume.h>
+
+#include <algorithm>
+
+namespace inviwo {
+
+BrickedVolume::BrickedVolume(size3_t dims, BrickGenerator generator, BoundFunction bound,
+                             size_t maxRetainedBytes)
+    : dims_(dims)
+    , brickCounts_((dims + size3_t(brickSize - 1)) / brickSize)
+    , generator_(std::move(generator))
+    , bound_(std::move(bound))
+    , modelMatrix_(1.0f)
+    , worldMatrix_(1.0f)
+    , brickMutexes_()
+    , bricks_(brickCounts_.x * brickCounts_.y * brickCounts_.z)
+    , computedBricks_(0)
+    , accessClock_(0)
+    , lastAccess_(bricks_.size())
+    , maxRetainedBytes_(maxRetainedBytes)
+    , retainedMutex_()
+    , retained_()
+    , retainedBytes_(0) {}
+
+size3_t BrickedVolume::getBrickDimensions(size3_t brick) const {
+    return glm::min(dims_ - brick * brickSize, size3_t(brickSize));
+}
+
+size_t BrickedVolume::brickBytes(size_t brick) const {
+    const size3_t dims = getBrickDimensions(
+        size3_t(brick % brickCounts_.x, (brick / brickCounts_.x) % brickCounts_.y,
+                brick / (brickCounts_.x * brickCounts_.y)));
+    return dims.x * dims.y * dims.z * sizeof(float);
+}
+
+std::shared_ptr<const float[]> BrickedVolume::getBrick(size3_t brick) const {
+    const size_t i = brick.x + brickCounts_.x * (brick.y + brickCounts_.y * brick.z);
+    lastAccess_[i].store(++accessClock_, std::memory_order_relaxed);
+    std::shared_ptr<const float[]> voxels;
+    {
+        std::lock_guard<std::mutex> lock(brickMutexes_[i % brickMutexCount]);
+        if (bricks_[i]) {
+            return bricks_[i];
+        }
+        const size3_t dims = getBrickDimensions(brick);
+        std::shared_ptr<float[]> data(new float[dims.x * dims.y * dims.z]);
+        generator_(brick * brickSize, dims, data.get());
+        voxels = bricks_[i] = std::move(data);
+        ++computedBricks_;
+    }
+
+    // Drop the least recently accessed bricks beyond the budget. The search is linear, but only
+    // runs after a brick was generated, which costs far more. Readers keep their voxels through
+    // the pointer.
+    std::lock_guard<std::mutex> lock(retainedMutex_);
+    retained_.push_back(i);
+    retainedBytes_ += brickBytes(i);
+    while (retainedBytes_ > maxRetainedBytes_ && !retained_.empty()) {
+        const auto least = std::min_element(
+            retained_.begin(), retained_.end(), [&](size_t a, size_t b) {
+                return lastAccess_[a].load(std::memory_order_relaxed) <
+                       lastAccess_[b].load(std::memory_order_relaxed);
+            });
+        const size_t dropped = *least;
+        *least = retained_.back();
+        retained_.pop_back();
+        retainedBytes_ -= brickBytes(dropped);
+        std::lock_guard<std::mutex> brickLock(brickMutexes_[dropped % brickMutexCount]);
+        bricks_[dropped].reset();
+    }
+    return voxels;
+}
+
+float BrickedVolume::getVoxel(size3_t pos) const {
+    const size3_t brick = pos / brickSize;
+    const size3_t local = pos - brick * brickSize;
+    const size3_t dims = getBrickDimensions(brick);
+    return getBrick(brick)[local.x + dims.x * (local.y + dims.y * local.z)];
+}
+
+size_t BrickedVolume::getRetainedBytes() const {
+    std::lock_guard<std::mutex> lock(retainedMutex_);
+    return retainedBytes_;
+}
+
+}  // namespace inviwo
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <modules/tnm067lab2/tnm067lab2moduledefine.h>
+#include <inviwo/core/util/glmvec.h>
+#include <inviwo/core/util/glmmat.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace inviwo {
+
+/**
+ * \class BrickedVolume
+ * \brief Scalar float volume split into bricks of brickSize^3 voxels, computed on first access
+ * Bricks are filled by the brick generator the first time any of their voxels are requested,
+ * which makes it possible to work with volumes that would not fit in memory as long as only a
+ * small part of them is touched. The bound function gives a cheap conservative value range for
+ * any voxel box without computing it, which lets consumers skip regions without touching them.
+ * Generated bricks are retained up to maxRetainedBytes, beyond that the least recently accessed
+ * ones are dropped and generated again on their next access. Accessing bricks is thread safe.
+ */
+class IVW_MODULE_TNM067LAB2_API BrickedVolume {
+public:
+    static constexpr size_t brickSize = 32;
+
+    /**
+     * Fills the brick with the given voxel offset and dimensions, x fastest
+     */
+    using BrickGenerator = std::function<void(size3_t offset, size3_t dims, float* data)>;
+    /**
+     * Returns a range containing all voxel values within the voxels [first, last] (inclusive)
+     */
+    using BoundFunction = std::function<dvec2(size3_t first, size3_t last)>;
+
+    BrickedVolume(size3_t dims, BrickGenerator generator, BoundFunction bound,
+                  size_t maxRetainedBytes = std::numeric_limits<size_t>::max());
+    BrickedVolume(const BrickedVolume&) = delete;
+    BrickedVolume& operator=(const BrickedVolume&) = delete;
+
+    const size3_t& getDimensions() const { return dims_; }
+    const size3_t& getBrickCounts() const { return brickCounts_; }
+    size3_t getBrickDimensions(size3_t brick) const;
+
+    /**
+     * Conservative value range of the voxels [first, last], see BoundFunction
+     */
+    dvec2 getBound(size3_t first, size3_t last) const { return bound_(first, last); }
+    dvec2 getValueRange() const { return bound_(size3_t(0), dims_ - size3_t(1)); }
+
+    /**
+     * Returns the voxels of the brick, generating them if they are not retained. The voxels stay
+     * valid as long as the returned pointer is held, also if the brick is dropped meanwhile.
+     */
+    std::shared_ptr<const float[]> getBrick(size3_t brick) const;
+    float getVoxel(size3_t pos) const;
+
+    /**
+     * Number of times a brick was generated, including bricks generated again after being dropped
+     */
+    size_t getComputedBrickCount() const { return computedBricks_; }
+    size_t getRetainedBytes() const;
+
+    const mat4& getModelMatrix() const { return modelMatrix_; }
+    const mat4& getWorldMatrix() const { return worldMatrix_; }
+    void setModelMatrix(const mat4& modelMatrix) { modelMatrix_ = modelMatrix; }
+    void setWorldMatrix(const mat4& worldMatrix) { worldMatrix_ = worldMatrix; }
+
+private:
+    size3_t dims_;
+    size3_t brickCounts_;
+    BrickGenerator generator_;
+    BoundFunction bound_;
+    mat4 modelMatrix_;
+    mat4 worldMatrix_;
+
+    size_t brickBytes(size_t brick) const;
+
+    // Guard the generation of bricks, brick i uses brickMutexes_[i % brickMutexCount]
+    static constexpr size_t brickMutexCount = 256;
+    mutable std::array<std::mutex, brickMutexCount> brickMutexes_;
+    mutable std::vector<std::shared_ptr<const float[]>> bricks_;
+    mutable std::atomic<size_t> computedBricks_;
+
+    // Time of the last access per brick, from accessClock_, compared to drop the least recently
+    // accessed retained brick. Updated without locks, so accesses to retained bricks stay cheap.
+    mutable std::atomic<std::uint64_t> accessClock_;
+    mutable std::vector<std::atomic<std::uint64_t>> lastAccess_;
+
+    // Retained bricks, in no particular order
+    size_t maxRetainedBytes_;
+    mutable std::mutex retainedMutex_;
+    mutable std::vector<size_t> retained_;
+    mutable size_t retainedBytes_;
+};
+
+}  // namespace inviwo
@@ -0,0 +1,144 @@
+#include <modules/tnm067lab2/utils/datvolumeio.h>
+#include <modules/tnm067lab2/utils/mappedfile.h>
+#include <inviwo/core/datastructures/volume/volume.h>
+#include <inviwo/core/datastructures/volume/volumeram.h>
+#include <inviwo/core/util/exception.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace inviwo {
+
+namespace util {
+
+DatVolumeHeader readDatHeader(const std::string& datFile) {
+    std::ifstream in(datFile);
+    if (!in) {
+        throw Exception("Could not open " + datFile, IVW_CONTEXT_CUSTOM("readDatHeader"));
+    }
+
+    const auto incomplete = [&]() {
+        return Exception("Incomplete volume header in " + datFile,
+                         IVW_CONTEXT_CUSTOM("readDatHeader"));
+    };
+
+    DatVolumeHeader header;
+    std::string line;
+    while (std::getline(in, line)) {
+        const auto colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        const std::string key = line.substr(0, colon);
+        std::istringstream values(line.substr(colon + 1));
+
+        if (key == "RawFile") {
+            std::string file;
+            values >> file;
+            header.rawFile =
+                (std::filesystem::path(datFile).parent_path() / file).lexically_normal().string();
+        } else if (key == "Resolution") {
+            values >> header.dimensions.x >> header.dimensions.y >> header.dimensions.z;
+        } else if (key == "Format") {
+            std::string format;
+            values >> format;
+            header.format = DataFormatBase::get(format);
+        } else if (key.rfind("BasisVector", 0) == 0 && key.size() == 12) {
+            if (key[11] < '1' || key[11] > '3') throw incomplete();
+            auto& v = header.basis[key[11] - '1'];
+            values >> v.x >> v.y >> v.z;
+        } else if (key == "Offset") {
+            values >> header.offset.x >> header.offset.y >> header.offset.z;
+        } else if (key.rfind("WorldVector", 0) == 0 && key.size() == 12) {
+            if (key[11] < '1' || key[11] > '4') throw incomplete();
+            auto& v = header.worldMatrix[key[11] - '1'];
+            values >> v.x >> v.y >> v.z >> v.w;
+        } else if (key == "DataRange") {
+            values >> header.dataRange.x >> header.dataRange.y;
+        } else if (key == "ValueRange") {
+            values >> header.valueRange.x >> header.valueRange.y;
+        }
+    }
+
+    if (header.rawFile.empty() || header.format == nullptr ||
+        header.dimensions.x * header.dimensions.y * header.dimensions.z == 0) {
+        throw incomplete();
+    }
+    return header;
+}
+
+std::shared_ptr<Volume> readDatVolume(const std::string& datFile) {
+    const auto header = readDatHeader(datFile);
+
+    MappedFile raw(header.rawFile);
+    const size_t bytes = header.dimensions.x * header.dimensions.y * header.dimensions.z *
+                         header.format->getSize();
+    if (raw.size() != bytes) {
+        throw Exception("Size of " + header.rawFile + " does not match " + datFile,
+                        IVW_CONTEXT_CUSTOM("readDatVolume"));
+    }
+
+    auto volume = std::make_shared<Volume>(header.dimensions, header.format);
+    volume->setBasis(header.basis);
+    volume->setOffset(header.offset);
+    volume->setWorldMatrix(header.worldMatrix);
+    volume->dataMap_.dataRange = header.dataRange;
+    volume->dataMap_.valueRange = header.valueRange;
+
+    auto ram = volume->getEditableRepresentation<VolumeRAM>();
+    std::memcpy(ram->getData(), raw.data(), bytes);
+    return volume;
+}
+
+void writeDatVolume(const Volume& volume, const std::string& datFile) {
+    const std::filesystem::path datPath(datFile);
+    const std::filesystem::path rawPath = std::filesystem::path(datPath).replace_extension(".raw");
+    const auto tmp = [](std::filesystem::path p) { return p += ".tmp"; };
+
+    const auto ram = volume.getRepresentation<VolumeRAM>();
+    const size3_t dims = ram->getDimensions();
+    const auto format = ram->getDataFormat();
+    {
+        std::ofstream out(tmp(rawPath), std::ios::binary);
+        out.write(static_cast<const char*>(ram->getData()),
+                  static_cast<std::streamsize>(dims.x * dims.y * dims.z * format->getSize()));
+        if (!out) {
+            throw Exception("Could not write " + rawPath.string(),
+                            IVW_CONTEXT_CUSTOM("writeDatVolume"));
+        }
+    }
+    {
+        std::ofstream out(tmp(datPath));
+        const auto basis = volume.getBasis();
+        const auto offset = volume.getOffset();
+        const auto world = volume.getWorldMatrix();
+        out.precision(std::numeric_limits<double>::max_digits10);
+        out << "RawFile: " << rawPath.filename().string() << "\n";
+        out << "Resolution: " << dims.x << " " << dims.y << " " << dims.z << "\n";
+        out << "Format: " << format->getString() << "\n";
+        for (int i = 0; i < 3; ++i) {
+            out << "BasisVector" << i + 1 << ": " << basis[i].x << " " << basis[i].y << " "
+                << basis[i].z << "\n";
+        }
+        out << "Offset: " << offset.x << " " << offset.y << " " << offset.z << "\n";
+        for (int i = 0; i < 4; ++i) {
+            out << "WorldVector" << i + 1 << ": " << world[i].x << " " << world[i].y << " "
+                << world[i].z << " " << world[i].w << "\n";
+        }
+        out << "DataRange: " << volume.dataMap_.dataRange.x << " " << volume.dataMap_.dataRange.y
+            << "\n";
+        out << "ValueRange: " << volume.dataMap_.valueRange.x << " "
+            << volume.dataMap_.valueRange.y << "\n";
+        if (!out) {
+            throw Exception("Could not write " + datPath.string(),
+                            IVW_CONTEXT_CUSTOM("writeDatVolume"));
+        }
+    }
+    std::filesystem::rename(tmp(rawPath), rawPath);
+    std::filesystem::rename(tmp(datPath), datPath);
+}
+
+}  // namespace util
+
+}  // namespace inviwo
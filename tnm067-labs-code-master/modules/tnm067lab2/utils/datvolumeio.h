@@ -0,0 +1,52 @@
+#pragma once
+
+#include <modules/tnm067lab2/tnm067lab2moduledefine.h>
+#include <inviwo/core/util/glmvec.h>
+
+#include <memory>
+#include <string>
+
+namespace inviwo {
+
+class Volume;
+class DataFormatBase;
+
+/**
+ * \brief Header of a .dat volume description, e.g. tnm067lab3/data/volumes/UVWf39.dat
+ * The voxels are stored uncompressed, x fastest, in the file given by RawFile.
+ */
+struct IVW_MODULE_TNM067LAB2_API DatVolumeHeader {
+    std::string rawFile;  // Absolute path, resolved relative to the .dat file
+    size3_t dimensions{0};
+    const DataFormatBase* format = nullptr;
+    mat3 basis{1.0f};
+    vec3 offset{-0.5f};
+    mat4 worldMatrix{1.0f};
+    dvec2 dataRange{0.0, 1.0};
+    dvec2 valueRange{0.0, 1.0};
+};
+
+namespace util {
+
+/**
+ * Parses the header of a .dat file. Throws an Exception if the file can not be read or is
+ * missing the RawFile, Resolution or Format entries.
+ */
+IVW_MODULE_TNM067LAB2_API DatVolumeHeader readDatHeader(const std::string& datFile);
+
+/**
+ * Reads a .dat/.raw volume by memory mapping the raw file and copying it into a VolumeRAM.
+ * Throws an Exception if the raw file does not match the header.
+ */
+IVW_MODULE_TNM067LAB2_API std::shared_ptr<Volume> readDatVolume(const std::string& datFile);
+
+/**
+ * Writes the volume as a .dat header and a .raw file with the same base name. The raw file is
+ * written first and both files are moved into place after they are complete, so an existing .dat
+ * file always refers to a complete raw file.
+ */
+IVW_MODULE_TNM067LAB2_API void writeDatVolume(const Volume& volume, const std::string& datFile);
+
+}  // namespace util
+
+}  // namespace inviwo
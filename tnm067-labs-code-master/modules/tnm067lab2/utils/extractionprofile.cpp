@@ -0,0 +1,81 @@
+#include <modules/tnm067lab2/utils/extractionprofile.h>
+
+#include <iomanip>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+
+namespace inviwo {
+
+namespace {
+
+std::mutex totalMutex;
+ExtractionProfile total;
+
+}  // namespace
+
+const std::array<ExtractionProfile::Info, ExtractionProfile::stageCount>
+    ExtractionProfile::stages{{{"cellSetup", "Cell setup"},
+                               {"classification", "Case classification"},
+                               {"interpolation", "Vertex interpolation"},
+                               {"edgeLookup", "Edge lookup"},
+                               {"addTriangle", "Add triangle"},
+                               {"meshCreation", "Mesh creation"}}};
+
+const std::array<ExtractionProfile::Info, ExtractionProfile::counterCount>
+    ExtractionProfile::counters{{{"activeCells", "Active cells"},
+                                 {"triangles", "Triangles"},
+                                 {"edgeHits", "Edge cache hits"},
+                                 {"edgeMisses", "Edge cache misses"}}};
+
+ExtractionProfile& ExtractionProfile::operator+=(const ExtractionProfile& other) {
+    for (size_t i = 0; i < stageCount; ++i) {
+        nanoseconds[i] += other.nanoseconds[i];
+    }
+    for (size_t i = 0; i < counterCount; ++i) {
+        counts[i] += other.counts[i];
+    }
+    return *this;
+}
+
+std::string ExtractionProfile::summary() const {
+    const double totalTime = static_cast<double>(
+        std::accumulate(nanoseconds.begin(), nanoseconds.end(), std::uint64_t{0}));
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    for (size_t i = 0; i < stageCount; ++i) {
+        ss << "\n  " << std::left << std::setw(22) << stages[i].name << std::right
+           << std::setw(10) << milliseconds(static_cast<Stage>(i)) << " ms" << std::setw(8)
+           << (totalTime > 0.0 ? 100.0 * nanoseconds[i] / totalTime : 0.0) << " %";
+    }
+    for (size_t i = 0; i < counterCount; ++i) {
+        ss << "\n  " << std::left << std::setw(22) << counters[i].name << std::right
+           << std::setw(10) << counts[i];
+    }
+    const auto lookups = count(Counter::EdgeHits) + count(Counter::EdgeMisses);
+    ss << "\n  " << std::left << std::setw(22) << "Edge cache hit rate" << std::right
+       << std::setw(10)
+       << (lookups > 0 ? 100.0 * count(Counter::EdgeHits) / lookups : 0.0) << " %";
+    return ss.str();
+}
+
+ExtractionProfile& ExtractionProfile::local() {
+    thread_local ExtractionProfile profile;
+    return profile;
+}
+
+void ExtractionProfile::collect() {
+    auto& profile = local();
+    std::lock_guard<std::mutex> lock(totalMutex);
+    total += profile;
+    profile = ExtractionProfile{};
+}
+
+ExtractionProfile ExtractionProfile::takeTotal() {
+    std::lock_guard<std::mutex> lock(totalMutex);
+    ExtractionProfile result = total;
+    total = ExtractionProfile{};
+    return result;
+}
+
+}  // namespace inviwo
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <modules/tnm067lab2/tnm067lab2moduledefine.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace inviwo {
+
+/**
+ * \class ExtractionProfile
+ * \brief Time spent in the stages of an iso surface extraction and counters of its work
+ * Every thread fills its own profile, see local, through the IVW_TNM067LAB2_PROFILE macros, which
+ * are empty unless the module is built with IVW_TNM067LAB2_PROFILING. The profiles of the threads
+ * are gathered by collect and taken by the processor with takeTotal. The stages are timed per cell
+ * and per vertex, so the timers add to the extraction time and mainly tell the stages apart.
+ */
+struct IVW_MODULE_TNM067LAB2_API ExtractionProfile {
+    enum class Stage {
+        CellSetup,       // loading the voxels of a cell
+        Classification,  // comparing the voxels of a cell to the iso values
+        Interpolation,   // positions and normals of new vertices
+        EdgeLookup,      // finding the vertex of an edge in the edge cache
+        AddTriangle,
+        MeshCreation  // conversion to an Inviwo mesh, e.g. toBasicMesh
+    };
+    static constexpr size_t stageCount = 6;
+
+    enum class Counter { ActiveCells, Triangles, EdgeHits, EdgeMisses };
+    static constexpr size_t counterCount = 4;
+
+    struct Info {
+        const char* identifier;
+        const char* name;
+    };
+    static const std::array<Info, stageCount> stages;
+    static const std::array<Info, counterCount> counters;
+
+    /**
+     * Measures the time from construction to destruction into the profile of the thread
+     */
+    class Timer {
+    public:
+        explicit Timer(Stage stage) : stage_{stage}, start_{std::chrono::steady_clock::now()} {}
+        ~Timer() {
+            local().add(stage_, std::chrono::steady_clock::now() - start_);
+        }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+    private:
+        Stage stage_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    void add(Stage stage, std::chrono::steady_clock::duration duration) {
+        nanoseconds[static_cast<size_t>(stage)] += static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+    void add(Counter counter, std::uint64_t count) {
+        counts[static_cast<size_t>(counter)] += count;
+    }
+    double milliseconds(Stage stage) const {
+        return static_cast<double>(nanoseconds[static_cast<size_t>(stage)]) * 1e-6;
+    }
+    std::uint64_t count(Counter counter) const { return counts[static_cast<size_t>(counter)]; }
+
+    ExtractionProfile& operator+=(const ExtractionProfile& other);
+    /**
+     * One line per stage and counter, with the share of the total time and the hit rate of the
+     * edge cache
+     */
+    std::string summary() const;
+
+    /**
+     * The profile of the calling thread
+     */
+    static ExtractionProfile& local();
+    /**
+     * Adds the profile of the calling thread to the total and clears it. Has to be called by
+     * every thread that extracted something before its work is taken.
+     */
+    static void collect();
+    /**
+     * Returns the total of all profiles collected since the last call and clears it
+     */
+    static ExtractionProfile takeTotal();
+
+    std::array<std::uint64_t, stageCount> nanoseconds{};
+    std::array<std::uint64_t, counterCount> counts{};
+};
+
+}  // namespace inviwo
+
+#ifdef IVW_TNM067LAB2_PROFILING
+#define IVW_TNM067LAB2_PROFILE_CONCAT_IMPL(a, b) a##b
+#define IVW_TNM067LAB2_PROFILE_CONCAT(a, b) IVW_TNM067LAB2_PROFILE_CONCAT_IMPL(a, b)
+#define IVW_TNM067LAB2_PROFILE_SCOPE(stage)                                               \
+    ::inviwo::ExtractionProfile::Timer IVW_TNM067LAB2_PROFILE_CONCAT(profileTimer, __LINE__)( \
+        ::inviwo::ExtractionProfile::Stage::stage)
+#define IVW_TNM067LAB2_PROFILE_COUNT(counter, n) \
+    ::inviwo::ExtractionProfile::local().add(::inviwo::ExtractionProfile::Counter::counter, n)
+#define IVW_TNM067LAB2_PROFILE_COLLECT() ::inviwo::ExtractionProfile::collect()
+#else
+#define IVW_TNM067LAB2_PROFILE_SCOPE(stage)
+#define IVW_TNM067LAB2_PROFILE_COUNT(counter, n)
+#define IVW_TNM067LAB2_PROFILE_COLLECT()
+#endif
@@ -0,0 +1,287 @@
+#include <modules/tnm067lab2/utils/hydrogenorbital.h>
+#include <inviwo/core/util/exception.h>
+#include <cmath>
+#include <algorithm>
+#include <string>
+
+namespace inviwo {
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+double factorial(int k) {
+    double res = 1.0;
+    for (int i = 2; i <= k; ++i) res *= i;
+    return res;
+}
+
+// Generalized Laguerre polynomial L_k^alpha(x) using the three term recurrence
+double laguerre(int k, int alpha, double x) {
+    double prev = 1.0;
+    if (k == 0) return prev;
+    double curr = 1.0 + alpha - x;
+    for (int i = 1; i < k; ++i) {
+        const double next = ((2 * i + 1 + alpha - x) * curr - (i + alpha) * prev) / (i + 1);
+        prev = curr;
+        curr = next;
+    }
+    return curr;
+}
+
+// Associated Legendre function P_l^m(x) for m >= 0, without the Condon-Shortley phase
+double legendre(int l, int m, double x) {
+    double pmm = 1.0;
+    const double s = std::sqrt(std::max(0.0, 1.0 - x * x));
+    for (int i = 1; i <= m; ++i) pmm *= (2 * i - 1) * s;
+    if (l == m) return pmm;
+    double pm1 = x * (2 * m + 1) * pmm;
+    for (int i = m + 2; i <= l; ++i) {
+        const double pl = (x * (2 * i - 1) * pm1 - (i + m - 1) * pmm) / (i - m);
+        pmm = pm1;
+        pm1 = pl;
+    }
+    return pm1;
+}
+
+double lookup(const std::vector<double>& table, double t) {
+    const double x = t * (table.size() - 1);
+    const size_t i = std::min(static_cast<size_t>(x), table.size() - 2);
+    const double w = x - i;
+    return table[i] + w * (table[i + 1] - table[i]);
+}
+
+// Like lookup, also sets slope to the derivative of the interpolated table with respect to t
+double lookup(const std::vector<double>& table, double t, double& slope) {
+    const double scale = static_cast<double>(table.size() - 1);
+    const double x = t * scale;
+    const size_t i = std::min(static_cast<size_t>(x), table.size() - 2);
+    const double w = x - i;
+    slope = (table[i + 1] - table[i]) * scale;
+    return table[i] + w * (table[i + 1] - table[i]);
+}
+
+std::vector<double> blockMaxima(const std::vector<double>& table, size_t blockSize) {
+    std::vector<double> maxima((table.size() + blockSize - 1) / blockSize, 0.0);
+    for (size_t i = 0; i < table.size(); ++i) {
+        maxima[i / blockSize] = std::max(maxima[i / blockSize], std::abs(table[i]));
+    }
+    return maxima;
+}
+
+// Maximum of the linearly interpolated |table| for t in [t0, t1], i.e. of all entries covering it
+double maxAbs(const std::vector<double>& table, const std::vector<double>& blockMax,
+              size_t blockSize, double t0, double t1) {
+    const double scale = static_cast<double>(table.size() - 1);
+    size_t i = static_cast<size_t>(std::floor(glm::clamp(t0, 0.0, 1.0) * scale));
+    const size_t last = static_cast<size_t>(std::ceil(glm::clamp(t1, 0.0, 1.0) * scale));
+
+    double res = 0.0;
+    while (i <= last) {
+        if (i % blockSize == 0 && i + blockSize - 1 <= last) {
+            res = std::max(res, blockMax[i / blockSize]);
+            i += blockSize;
+        } else {
+            res = std::max(res, std::abs(table[i]));
+            ++i;
+        }
+    }
+    return res;
+}
+
+// Minimum of the linearly interpolated |table| for t in [t0, t1], zero if the entries covering it
+// change sign
+double minAbs(const std::vector<double>& table, double t0, double t1) {
+    const double scale = static_cast<double>(table.size() - 1);
+    const size_t first = static_cast<size_t>(std::floor(glm::clamp(t0, 0.0, 1.0) * scale));
+    const size_t last = static_cast<size_t>(std::ceil(glm::clamp(t1, 0.0, 1.0) * scale));
+
+    double res = std::abs(table[first]);
+    for (size_t i = first + 1; i <= last; ++i) {
+        if ((table[i] < 0.0) != (table[first] < 0.0)) return 0.0;
+        res = std::min(res, std::abs(table[i]));
+    }
+    return res;
+}
+
+/**
+ * Ranges of r, of u = cos(theta) and of the azimuth phi in [0, pi / 2] within a box, after the
+ * box is folded into the first octant like the positions in HydrogenOrbital::density
+ */
+struct BoxRanges {
+    double rMin, rMax;
+    double uMin, uMax;
+    double phiMin, phiMax;
+};
+
+BoxRanges boxRanges(vec3 boxMin, vec3 boxMax) {
+    // lo and hi are the closest and farthest corners of the folded box
+    dvec3 lo{0.0};
+    dvec3 hi{0.0};
+    for (size_t i = 0; i < 3; ++i) {
+        const double a = std::abs(boxMin[i]);
+        const double b = std::abs(boxMax[i]);
+        lo[i] = (boxMin[i] <= 0.0 && boxMax[i] >= 0.0) ? 0.0 : std::min(a, b);
+        hi[i] = std::max(a, b);
+    }
+    BoxRanges ranges;
+    ranges.rMin = glm::length(lo);
+    ranges.rMax = glm::length(hi);
+    ranges.uMin = ranges.rMax == 0.0 ? 1.0 : lo.z / ranges.rMax;
+    ranges.uMax = ranges.rMin == 0.0 ? 1.0 : std::min(1.0, hi.z / ranges.rMin);
+    // Positions on the z axis have phi = 0, see HydrogenOrbital::azimuthal
+    ranges.phiMin = hi.x == 0.0 ? 0.0 : std::atan2(lo.y, hi.x);
+    ranges.phiMax = lo.x == 0.0 && hi.y > 0.0 ? pi / 2.0 : std::atan2(hi.y, lo.x);
+    return ranges;
+}
+
+}  // namespace
+
+HydrogenOrbital::HydrogenOrbital(int n, int l, int m)
+    : n_(n)
+    , l_(l)
+    , m_(m)
+    , radial_(tableSize)
+    , polar_(tableSize)
+    , radialBlockMax_()
+    , polarBlockMax_()
+    , maxDensity_(0.0) {
+    if (n < 1 || l < 0 || l >= n || std::abs(m) > l) {
+        throw Exception("Invalid quantum numbers (" + std::to_string(n) + ", " +
+                            std::to_string(l) + ", " + std::to_string(m) + ")",
+                        IVW_CONTEXT_CUSTOM("HydrogenOrbital"));
+    }
+
+    const double radialNorm =
+        std::sqrt(std::pow(2.0 / n, 3) * factorial(n - l - 1) / (2.0 * n * factorial(n + l)));
+    for (size_t i = 0; i < tableSize; ++i) {
+        const double r = maxRadius * i / (tableSize - 1);
+        const double rho = 2.0 * r / n;
+        radial_[i] = radialNorm * std::exp(-rho / 2.0) * std::pow(rho, l) *
+                     laguerre(n - l - 1, 2 * l + 1, rho);
+    }
+
+    const int am = std::abs(m);
+    const double polarNorm = std::sqrt((2 * l + 1) / (4.0 * pi) * factorial(l - am) /
+                                       factorial(l + am)) *
+                             (m == 0 ? 1.0 : std::sqrt(2.0));
+    for (size_t i = 0; i < tableSize; ++i) {
+        const double u = static_cast<double>(i) / (tableSize - 1);
+        polar_[i] = polarNorm * legendre(l, am, u);
+    }
+
+    radialBlockMax_ = blockMaxima(radial_, tableBlockSize);
+    polarBlockMax_ = blockMaxima(polar_, tableBlockSize);
+
+    // The azimuthal factor is at most one
+    const double maxRadial = *std::max_element(radialBlockMax_.begin(), radialBlockMax_.end());
+    const double maxPolar = *std::max_element(polarBlockMax_.begin(), polarBlockMax_.end());
+    maxDensity_ = maxRadial * maxRadial * maxPolar * maxPolar;
+}
+
+mat4 HydrogenOrbital::modelMatrix() { return mat4(1.0f); }
+
+double HydrogenOrbital::maxDensity(vec3 boxMin, vec3 boxMax) const {
+    const BoxRanges box = boxRanges(boxMin, boxMax);
+    const double maxRadial = maxAbs(radial_, radialBlockMax_, tableBlockSize,
+                                    box.rMin / maxRadius, box.rMax / maxRadius);
+    const double maxPolar = maxAbs(polar_, polarBlockMax_, tableBlockSize, box.uMin, box.uMax);
+    return maxRadial * maxRadial * maxPolar * maxPolar;
+}
+
+double HydrogenOrbital::minDensity(vec3 boxMin, vec3 boxMax) const {
+    const BoxRanges box = boxRanges(boxMin, boxMax);
+    const double minRadial = minAbs(radial_, box.rMin / maxRadius, box.rMax / maxRadius);
+    const double minPolar = minAbs(polar_, box.uMin, box.uMax);
+
+    // |cos(|m| phi)| or |sin(|m| phi)| has its minimum at an end of the range unless the range
+    // contains one of its zeros
+    double minAzimuthal = 1.0;
+    if (m_ != 0) {
+        const int am = std::abs(m_);
+        const double shift = m_ > 0 ? 0.5 : 0.0;
+        const double zero = (std::ceil(box.phiMin * am / pi - shift) + shift) * pi / am;
+        if (zero <= box.phiMax) {
+            minAzimuthal = 0.0;
+        } else {
+            const auto factor = [&](double phi) {
+                return std::abs(m_ > 0 ? std::cos(am * phi) : std::sin(am * phi));
+            };
+            minAzimuthal = std::min(factor(box.phiMin), factor(box.phiMax));
+        }
+    }
+    const double psi = minRadial * minPolar * minAzimuthal;
+    return psi * psi;
+}
+
+double HydrogenOrbital::density(vec3 cartesian) const {
+    const dvec3 p{glm::abs(cartesian)};
+    const double rho = std::sqrt(p.x * p.x + p.y * p.y);
+    const double r = std::sqrt(rho * rho + p.z * p.z);
+    const double u = r == 0.0 ? 1.0 : p.z / r;
+
+    const double psi = radial(r) * polar(u) * azimuthal(p.x, p.y, rho);
+    return psi * psi;
+}
+
+double HydrogenOrbital::density(vec3 cartesian, dvec3& gradient) const {
+    const dvec3 p{glm::abs(cartesian)};
+    const double rho = std::sqrt(p.x * p.x + p.y * p.y);
+    const double r = std::sqrt(rho * rho + p.z * p.z);
+    const double u = r == 0.0 ? 1.0 : p.z / r;
+
+    // Factors of psi and their derivatives with respect to r, u and phi
+    double dRadial = 0.0;
+    const double radialValue = lookup(radial_, std::min(r / maxRadius, 1.0), dRadial);
+    // The table is clamped beyond maxRadius
+    dRadial = r < maxRadius ? dRadial / maxRadius : 0.0;
+    double dPolar = 0.0;
+    const double polarValue = lookup(polar_, u, dPolar);
+    double dAzimuthal = 0.0;
+    const double azimuthalValue = azimuthal(p.x, p.y, rho, dAzimuthal);
+    const double psi = radialValue * polarValue * azimuthalValue;
+
+    // Gradients of r, u and phi in the first octant, zero where they are not defined
+    const dvec3 dr = r == 0.0 ? dvec3(0.0) : p / r;
+    const dvec3 du =
+        r == 0.0 ? dvec3(0.0) : dvec3(-p.z * p.x, -p.z * p.y, rho * rho) / (r * r * r);
+    const dvec3 dphi = rho == 0.0 ? dvec3(0.0) : dvec3(-p.y, p.x, 0.0) / (rho * rho);
+
+    const dvec3 dpsi = dRadial * polarValue * azimuthalValue * dr +
+                       radialValue * dPolar * azimuthalValue * du +
+                       radialValue * polarValue * dAzimuthal * dphi;
+    // Unfold from the first octant, the gradient is zero on the mirror planes
+    gradient = 2.0 * psi * dpsi * glm::sign(dvec3(cartesian));
+    return psi * psi;
+}
+
+double HydrogenOrbital::radial(double r) const {
+    return lookup(radial_, std::min(r / maxRadius, 1.0));
+}
+
+double HydrogenOrbital::polar(double u) const { return lookup(polar_, u); }
+
+double HydrogenOrbital::azimuthal(double x, double y, double rho) const {
+    double derivative;
+    return azimuthal(x, y, rho, derivative);
+}
+
+double HydrogenOrbital::azimuthal(double x, double y, double rho, double& derivative) const {
+    derivative = 0.0;
+    if (m_ == 0) return 1.0;
+    // (c + is)^|m| = cos(|m| phi) + i sin(|m| phi)
+    const double c = rho == 0.0 ? 1.0 : x / rho;
+    const double s = rho == 0.0 ? 0.0 : y / rho;
+    double cm = 1.0;
+    double sm = 0.0;
+    for (int i = 0; i < std::abs(m_); ++i) {
+        const double tmp = cm * c - sm * s;
+        sm = sm * c + cm * s;
+        cm = tmp;
+    }
+    // d/dphi cos(|m| phi) = -|m| sin(|m| phi) and d/dphi sin(|m| phi) = |m| cos(|m| phi)
+    derivative = m_ > 0 ? -std::abs(m_) * sm : std::abs(m_) * cm;
+    return m_ > 0 ? cm : sm;
+}
+
+}  // namespace inviwo
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <modules/tnm067lab2/tnm067lab2moduledefine.h>
+
+#include <vector>
+#include <inviwo/core/util/glmmat.h>
+#include <inviwo/core/util/glmvec.h>
+
+namespace inviwo {
+
+/**
+ * \class HydrogenOrbital
+ * \brief Tabulated probability density of the hydrogen orbital (n, l, m)
+ * The wave function is factored into the radial function R_nl(r), the polar part of the real
+ * spherical harmonic as a function of cos(theta) and the azimuthal part cos(m phi) / sin(|m| phi).
+ * The first two are sampled once at a fixed resolution and linearly interpolated, the azimuthal
+ * part is evaluated with a Chebyshev recurrence on x / rho and y / rho. Evaluating the density
+ * thereby costs a square root and two table lookups instead of pow, exp and inverse trigonometric
+ * functions. All quantities are in units of the Bohr radius.
+ */
+class IVW_MODULE_TNM067LAB2_API HydrogenOrbital {
+public:
+    static constexpr size_t tableSize = 4096;
+    // Distance from the origin to the corners of the [-18, 18]^3 domain
+    static constexpr double maxRadius = 18.0 * 1.7320508075688772;
+
+    HydrogenOrbital(int n, int l, int m);
+
+    /**
+     * Model matrix of the volumes of HydrogenGenerator, whose voxels span [0, 1]^3 for the
+     * domain. The bricked volumes and the surfaces of util::extractOrbitalSurface are placed the
+     * same way. The basis is the unit cube with no offset, the default of a Volume.
+     */
+    static mat4 modelMatrix();
+
+    int n() const { return n_; }
+    int l() const { return l_; }
+    int m() const { return m_; }
+
+    /**
+     * Probability density |psi_nlm|^2 at the given cartesian position. The density is mirror
+     * symmetric in x, y and z and the position is folded into the first octant before the
+     * evaluation, which makes the result exactly symmetric in floating point.
+     */
+    double density(vec3 cartesian) const;
+
+    /**
+     * Density like density(cartesian) that also returns its gradient in units of the Bohr radius.
+     * The gradient is exact for the tabulated density, i.e. it uses the slopes of the interpolated
+     * table entries, and shares the square roots, lookups and the recurrence with the density.
+     * It is mirror symmetric like the density, up to the sign of the mirrored component.
+     */
+    double density(vec3 cartesian, dvec3& gradient) const;
+
+    /**
+     * Upper bound of the density over the domain. Since r, theta and phi vary independently it is
+     * the product of the maxima of the factors and thereby tight up to the table resolution.
+     */
+    double maxDensity() const { return maxDensity_; }
+
+    /**
+     * Conservative upper bound of the density within the axis aligned box [boxMin, boxMax], from
+     * the ranges of r and cos(theta) covered by the box. Cheap enough to cull large regions.
+     */
+    double maxDensity(vec3 boxMin, vec3 boxMax) const;
+
+    /**
+     * Conservative lower bound of the density within the axis aligned box [boxMin, boxMax], like
+     * maxDensity(boxMin, boxMax). It is zero if one of the factors changes sign within the box,
+     * e.g. if the box contains a nodal surface.
+     */
+    double minDensity(vec3 boxMin, vec3 boxMax) const;
+
+private:
+    double radial(double r) const;
+    double polar(double u) const;
+    double azimuthal(double x, double y, double rho) const;
+    // Also sets derivative to the derivative with respect to phi
+    double azimuthal(double x, double y, double rho, double& derivative) const;
+
+    int n_;
+    int l_;
+    int m_;
+    std::vector<double> radial_;  // R_nl(r) for r in [0, maxRadius]
+    std::vector<double> polar_;   // N_lm * P_l^|m|(u) for u = cos(theta) in [0, 1]
+    // Maximum of |table| over consecutive blocks of tableBlockSize entries
+    static constexpr size_t tableBlockSize = 64;
+    std::vector<double> radialBlockMax_;
+    std::vector<double> polarBlockMax_;
+    double maxDensity_;
+};
+
+}  // namespace inviwo
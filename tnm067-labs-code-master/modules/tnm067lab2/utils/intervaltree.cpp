@@ -0,0 +1,89 @@
+#include <modules/tnm067lab2/utils/intervaltree.h>
+
+#include <algorithm>
+
+namespace inviwo {
+
+IntervalTree::IntervalTree(const std::vector<vec2>& intervals) {
+    std::vector<Entry> entries;
+    for (size_t i = 0; i < intervals.size(); ++i) {
+        if (intervals[i].x < intervals[i].y) {
+            entries.push_back({intervals[i], i});
+        }
+    }
+    byMin_.reserve(entries.size());
+    byMax_.reserve(entries.size());
+    build(entries);
+}
+
+size_t IntervalTree::build(std::vector<Entry>& entries) {
+    if (entries.empty()) {
+        return none;
+    }
+
+    // The median endpoint is contained in at least one interval, so every node stores at least
+    // one interval and both subtrees get at most half of the endpoints
+    std::vector<float> endpoints;
+    endpoints.reserve(2 * entries.size());
+    for (const auto& entry : entries) {
+        endpoints.push_back(entry.interval.x);
+        endpoints.push_back(entry.interval.y);
+    }
+    const auto median = endpoints.begin() + endpoints.size() / 2;
+    std::nth_element(endpoints.begin(), median, endpoints.end());
+    const float center = *median;
+
+    std::vector<Entry> left;
+    std::vector<Entry> right;
+    const size_t begin = byMin_.size();
+    for (const auto& entry : entries) {
+        if (entry.interval.y < center) {
+            left.push_back(entry);
+        } else if (entry.interval.x > center) {
+            right.push_back(entry);
+        } else {
+            byMin_.push_back(entry);
+            byMax_.push_back(entry);
+        }
+    }
+    const size_t end = byMin_.size();
+    std::sort(byMin_.begin() + begin, byMin_.end(),
+              [](const Entry& a, const Entry& b) { return a.interval.x < b.interval.x; });
+    std::sort(byMax_.begin() + begin, byMax_.end(),
+              [](const Entry& a, const Entry& b) { return a.interval.y > b.interval.y; });
+    entries.clear();
+    entries.shrink_to_fit();
+
+    const size_t node = nodes_.size();
+    nodes_.push_back({center, none, none, begin, end});
+    const size_t leftNode = build(left);
+    const size_t rightNode = build(right);
+    nodes_[node].left = leftNode;
+    nodes_[node].right = rightNode;
+    return node;
+}
+
+void IntervalTree::query(float value, std::vector<size_t>& result) const {
+    size_t node = nodes_.empty() ? none : 0;
+    while (node != none) {
+        const Node& n = nodes_[node];
+        if (value < n.center) {
+            // All intervals of the node end at or above center
+            for (size_t i = n.begin; i < n.end && byMin_[i].interval.x < value; ++i) {
+                result.push_back(byMin_[i].index);
+            }
+            node = n.left;
+        } else {
+            // All intervals of the node start at or below center
+            for (size_t i = n.begin; i < n.end && byMax_[i].interval.y >= value; ++i) {
+                if (byMax_[i].interval.x < value) {
+                    result.push_back(byMax_[i].index);
+                }
+            }
+            // The intervals to the right start above center
+            node = value > n.center ? n.right : none;
+        }
+    }
+}
+
+}  // namespace inviwo
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <modules/tnm067lab2/tnm067lab2moduledefine.h>
+#include <inviwo/core/util/glmvec.h>
+
+#include <limits>
+#include <vector>
+
+namespace inviwo {
+
+/**
+ * \class IntervalTree
+ * \brief Static centered interval tree for stabbing queries
+ * Finds the intervals (x, y) with x < value <= y in O(log n + k) for k results, i.e. the
+ * intervals of value ranges that cross an iso value. Empty intervals never match and are not
+ * stored.
+ */
+class IVW_MODULE_TNM067LAB2_API IntervalTree {
+public:
+    IntervalTree() = default;
+    explicit IntervalTree(const std::vector<vec2>& intervals);
+
+    /**
+     * Appends the indices of all intervals with x < value <= y to result, in no particular order
+     */
+    void query(float value, std::vector<size_t>& result) const;
+
+    size_t size() const { return byMin_.size(); }
+
+private:
+    static constexpr size_t none = std::numeric_limits<size_t>::max();
+
+    struct Node {
+        float center;
+        size_t left;
+        size_t right;
+        // The intervals containing center, [begin, end) in byMin_ and byMax_
+        size_t begin;
+        size_t end;
+    };
+    struct Entry {
+        vec2 interval;
+        size_t index;
+    };
+
+    size_t build(std::vector<Entry>& entries);
+
+    std::vector<Node> nodes_;
+    std::vector<Entry> byMin_;  // increasing x within each node
+    std::vector<Entry> byMax_;  // decreasing y within each node
+};
+
+}  // namespace inviwo
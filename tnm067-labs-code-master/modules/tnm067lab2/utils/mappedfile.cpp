@@ -0,0 +1,80 @@
+#include <modules/tnm067lab2/utils/mappedfile.h>
+#include <inviwo/core/util/exception.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace inviwo {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path)
+    : data_(nullptr), size_(0), file_(INVALID_HANDLE_VALUE), mapping_(nullptr) {
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+        throw Exception("Could not open " + path, IVW_CONTEXT_CUSTOM("MappedFile"));
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file_, &size);
+    size_ = static_cast<size_t>(size.QuadPart);
+    if (size_ == 0) return;
+
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_) {
+        data_ = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (!data_) {
+        if (mapping_) CloseHandle(mapping_);
+        CloseHandle(file_);
+        throw Exception("Could not map " + path, IVW_CONTEXT_CUSTOM("MappedFile"));
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) : data_(nullptr), size_(0), file_(-1) {
+    file_ = open(path.c_str(), O_RDONLY);
+    if (file_ < 0) {
+        throw Exception("Could not open " + path, IVW_CONTEXT_CUSTOM("MappedFile"));
+    }
+    struct stat info;
+    fstat(file_, &info);
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ == 0) return;
+
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_, 0);
+    if (data == MAP_FAILED) {
+        close(file_);
+        throw Exception("Could not map " + path, IVW_CONTEXT_CUSTOM("MappedFile"));
+    }
+    madvise(data, size_, MADV_SEQUENTIAL);
+    data_ = data;
+}
+
+MappedFile::~MappedFile() {
+    if (data_) munmap(const_cast<void*>(data_), size_);
+    if (file_ >= 0) close(file_);
+}
+
+#endif
+
+}  // namespace inviwo
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <modules/tnm067lab2/tnm067lab2moduledefine.h>
+
+#include <string>
+#include <cstddef>
+
+namespace inviwo {
+
+/**
+ * \class MappedFile
+ * \brief Read-only memory mapping of a whole file
+ * The mapping is released when the object is destroyed. Throws an Exception if the file can not
+ * be opened or mapped.
+ */
+class IVW_MODULE_TNM067LAB2_API MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const void* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const void* data_;
+    size_t size_;
+#ifdef _WIN32
+    void* file_;
+    void* mapping_;
+#else
+    int file_;
+#endif
+};
+
+}  // namespace inviwo
@@ -0,0 +1,560 @@
+#include <modules/tnm067lab2/utils/meshdecimation.h>
+#include <modules/tnm067lab2/utils/normalencoding.h>
+#include <inviwo/core/datastructures/geometry/basicmesh.h>
+#include <inviwo/core/datastructures/buffer/bufferram.h>
+#include <inviwo/core/util/exception.h>
+#include <inviwo/core/util/glm.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace inviwo {
+
+namespace {
+
+using Triangle = std::array<std::uint32_t, 3>;
+constexpr std::uint32_t noVertex = std::numeric_limits<std::uint32_t>::max();
+
+/**
+ * Sum of the squared distances to a set of planes as a symmetric 4x4 matrix
+ */
+struct Quadric {
+    // aa, ab, ac, ad, bb, bc, bd, cc, cd, dd of the planes ax + by + cz + d = 0
+    double q[10] = {};
+
+    static Quadric plane(const vec3& normal, const vec3& point) {
+        const double a = normal.x;
+        const double b = normal.y;
+        const double c = normal.z;
+        const double d = -(a * point.x + b * point.y + c * point.z);
+        return {{a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d}};
+    }
+
+    Quadric& operator+=(const Quadric& other) {
+        for (size_t i = 0; i < 10; ++i) q[i] += other.q[i];
+        return *this;
+    }
+
+    double error(const vec3& v) const {
+        const double x = v.x;
+        const double y = v.y;
+        const double z = v.z;
+        return std::max(0.0, q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x +
+                                 q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y + q[7] * z * z +
+                                 2 * q[8] * z + q[9]);
+    }
+
+    /**
+     * Finds the point of least error, returns false if it is not unique
+     */
+    bool minimum(vec3& v) const {
+        // Cramer's rule for the gradient being zero
+        const double a[3][3] = {{q[0], q[1], q[2]}, {q[1], q[4], q[5]}, {q[2], q[5], q[7]}};
+        const double b[3] = {-q[3], -q[6], -q[8]};
+        const auto det = [](const double m[3][3]) {
+            return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                   m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                   m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+        };
+        const double d = det(a);
+        const double scale = (q[0] + q[4] + q[7]) / 3.0;
+        if (!(std::abs(d) > 1e-6 * scale * scale * scale)) return false;
+
+        double x[3];
+        for (size_t k = 0; k < 3; ++k) {
+            double m[3][3];
+            for (size_t i = 0; i < 3; ++i) {
+                for (size_t j = 0; j < 3; ++j) m[i][j] = j == k ? b[i] : a[i][j];
+            }
+            x[k] = det(m) / d;
+        }
+        v = vec3(static_cast<float>(x[0]), static_cast<float>(x[1]), static_cast<float>(x[2]));
+        return true;
+    }
+};
+
+vec3 faceNormal(const vec3& p0, const vec3& p1, const vec3& p2) {
+    return glm::cross(p1 - p0, p2 - p0);
+}
+
+/**
+ * Edge collapses within one partition. Locked vertices are never removed or moved, shared vertices
+ * are locked vertices that are used by other partitions as well.
+ */
+class Decimator {
+public:
+    Decimator(std::vector<vec3> positions, std::vector<vec3> normals,
+              std::vector<Quadric> quadrics, std::vector<char> locked, std::vector<char> shared,
+              std::vector<Triangle> triangles)
+        : positions(std::move(positions))
+        , normals(std::move(normals))
+        , triangles(std::move(triangles))
+        , alive(this->triangles.size(), 1)
+        , quadrics_(std::move(quadrics))
+        , locked_(std::move(locked))
+        , shared_(std::move(shared))
+        , adjacency_(this->positions.size())
+        , stamps_(this->positions.size(), 0)
+        , removed_(this->positions.size(), 0)
+        , liveTriangles_(this->triangles.size()) {
+        for (std::uint32_t t = 0; t < this->triangles.size(); ++t) {
+            for (auto v : this->triangles[t]) adjacency_[v].push_back(t);
+        }
+    }
+
+    void run(size_t targetTriangles, double maxCost) {
+        for (std::uint32_t t = 0; t < triangles.size(); ++t) {
+            for (size_t k = 0; k < 3; ++k) {
+                // Interior edges are used in both directions, push them once
+                const auto a = triangles[t][k];
+                const auto b = triangles[t][(k + 1) % 3];
+                if (a < b) push(a, b);
+            }
+        }
+
+        while (liveTriangles_ > targetTriangles && !queue_.empty()) {
+            const Collapse c = queue_.top();
+            queue_.pop();
+            if (removed_[c.keep] || removed_[c.remove] || stamps_[c.keep] != c.stamps[0] ||
+                stamps_[c.remove] != c.stamps[1]) {
+                continue;
+            }
+            if (c.cost > maxCost) break;
+            if (isValid(c)) apply(c);
+        }
+    }
+
+    std::vector<vec3> positions;
+    std::vector<vec3> normals;
+    std::vector<Triangle> triangles;
+    std::vector<char> alive;
+
+private:
+    struct Collapse {
+        double cost;
+        std::uint32_t keep;
+        std::uint32_t remove;
+        vec3 pos;
+        std::uint32_t stamps[2];
+
+        bool operator>(const Collapse& other) const { return cost > other.cost; }
+    };
+
+    void push(std::uint32_t a, std::uint32_t b) {
+        if (locked_[a] && locked_[b]) return;
+
+        Collapse c;
+        if (locked_[b]) std::swap(a, b);
+        c.keep = a;
+        c.remove = b;
+        Quadric q = quadrics_[a];
+        q += quadrics_[b];
+        if (locked_[a]) {
+            c.pos = positions[a];
+        } else if (!q.minimum(c.pos)) {
+            // Flat or straight regions, take the best of the midpoint and the ends
+            const vec3 candidates[3] = {0.5f * (positions[a] + positions[b]), positions[a],
+                                        positions[b]};
+            c.pos = candidates[0];
+            for (const auto& candidate : candidates) {
+                if (q.error(candidate) < q.error(c.pos)) c.pos = candidate;
+            }
+        }
+        c.cost = q.error(c.pos);
+        c.stamps[0] = stamps_[c.keep];
+        c.stamps[1] = stamps_[c.remove];
+        queue_.push(c);
+    }
+
+    bool contains(const Triangle& t, std::uint32_t v) const {
+        return t[0] == v || t[1] == v || t[2] == v;
+    }
+
+    bool isValid(const Collapse& c) const {
+        // The edge has to be shared by exactly two triangles, and the two vertices must have no
+        // other common neighbors, otherwise the collapse makes the mesh non-manifold
+        size_t shared = 0;
+        std::vector<std::uint32_t> keepNeighbors;
+        for (auto t : adjacency_[c.keep]) {
+            if (!alive[t]) continue;
+            if (contains(triangles[t], c.remove)) ++shared;
+            for (auto v : triangles[t]) {
+                if (v != c.keep) keepNeighbors.push_back(v);
+            }
+        }
+        if (shared != 2) return false;
+        std::sort(keepNeighbors.begin(), keepNeighbors.end());
+        keepNeighbors.erase(std::unique(keepNeighbors.begin(), keepNeighbors.end()),
+                            keepNeighbors.end());
+
+        std::vector<std::uint32_t> removeNeighbors;
+        for (auto t : adjacency_[c.remove]) {
+            if (!alive[t]) continue;
+            for (auto v : triangles[t]) {
+                if (v != c.remove && v != c.keep) removeNeighbors.push_back(v);
+            }
+        }
+        std::sort(removeNeighbors.begin(), removeNeighbors.end());
+        removeNeighbors.erase(std::unique(removeNeighbors.begin(), removeNeighbors.end()),
+                              removeNeighbors.end());
+        size_t common = 0;
+        for (auto v : removeNeighbors) {
+            common += std::binary_search(keepNeighbors.begin(), keepNeighbors.end(), v);
+        }
+        if (common != 2) return false;
+
+        // Edges between shared vertices may be used by other partitions, which can not be seen
+        // from here, so no new ones are created
+        if (shared_[c.keep]) {
+            for (auto v : removeNeighbors) {
+                if (shared_[v] &&
+                    !std::binary_search(keepNeighbors.begin(), keepNeighbors.end(), v)) {
+                    return false;
+                }
+            }
+        }
+
+        // The remaining triangles around the edge must not flip or collapse
+        for (auto v : {c.keep, c.remove}) {
+            for (auto t : adjacency_[v]) {
+                const auto& tri = triangles[t];
+                if (!alive[t] || (contains(tri, c.keep) && contains(tri, c.remove))) continue;
+                vec3 p[3];
+                for (size_t k = 0; k < 3; ++k) {
+                    p[k] = tri[k] == v ? c.pos : positions[tri[k]];
+                }
+                const vec3 before =
+                    faceNormal(positions[tri[0]], positions[tri[1]], positions[tri[2]]);
+                const vec3 after = faceNormal(p[0], p[1], p[2]);
+                if (glm::dot(before, after) <= 0.0f ||
+                    glm::length(after) <= 1e-6f * glm::length(before)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void apply(const Collapse& c) {
+        positions[c.keep] = c.pos;
+        const vec3 normal = normals[c.keep] + normals[c.remove];
+        if (glm::length(normal) > 0.0f) normals[c.keep] = glm::normalize(normal);
+        quadrics_[c.keep] += quadrics_[c.remove];
+        removed_[c.remove] = 1;
+        ++stamps_[c.keep];
+        ++stamps_[c.remove];
+
+        for (auto t : adjacency_[c.remove]) {
+            if (!alive[t]) continue;
+            auto& tri = triangles[t];
+            if (contains(tri, c.keep)) {
+                alive[t] = 0;
+                --liveTriangles_;
+            } else {
+                std::replace(tri.begin(), tri.end(), c.remove, c.keep);
+                adjacency_[c.keep].push_back(t);
+            }
+        }
+        adjacency_[c.remove].clear();
+        auto& around = adjacency_[c.keep];
+        around.erase(std::remove_if(around.begin(), around.end(),
+                                    [&](std::uint32_t t) { return !alive[t]; }),
+                     around.end());
+
+        // Each edge around keep follows keep in exactly one of its triangles
+        for (auto t : around) {
+            const auto& tri = triangles[t];
+            for (size_t k = 0; k < 3; ++k) {
+                if (tri[k] == c.keep) push(c.keep, tri[(k + 1) % 3]);
+            }
+        }
+    }
+
+    std::vector<Quadric> quadrics_;
+    std::vector<char> locked_;
+    std::vector<char> shared_;
+    std::vector<std::vector<std::uint32_t>> adjacency_;  // triangles of each vertex
+    std::vector<std::uint32_t> stamps_;                  // changes of each vertex
+    std::vector<char> removed_;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue_;
+    size_t liveTriangles_;
+};
+
+}  // namespace
+
+namespace util {
+
+std::shared_ptr<BasicMesh> decimateMesh(const Mesh& mesh, float targetRatio, float maxError,
+                                        size_t partitions) {
+    // Quantized positions are decimated in the unit cube they were quantized over, so maxError
+    // means the same as for vec3 positions, and the model matrix takes the scale back
+    const auto positionBuffer = mesh.findBuffer(BufferType::PositionAttrib).first;
+    mat4 modelMatrix = mesh.getModelMatrix();
+    std::vector<vec3> dequantized;
+    const std::vector<vec3>* positionData = nullptr;
+    if (const auto buffer = dynamic_cast<const Buffer<vec3>*>(positionBuffer)) {
+        positionData = &buffer->getRAMRepresentation()->getDataContainer();
+    } else if (const auto quantized = dynamic_cast<const Buffer<glm::u16vec3>*>(positionBuffer)) {
+        const auto& data = quantized->getRAMRepresentation()->getDataContainer();
+        dequantized.reserve(data.size());
+        for (const auto& p : data) {
+            dequantized.push_back(vec3(p) / 65535.0f);
+        }
+        modelMatrix = glm::scale(modelMatrix, vec3(65535.0f));
+        positionData = &dequantized;
+    } else {
+        throw Exception("Mesh decimation requires vec3 or u16vec3 positions",
+                        IVW_CONTEXT_CUSTOM("decimateMesh"));
+    }
+    const auto& positions = *positionData;
+
+    const auto normalBuffer = mesh.findBuffer(BufferType::NormalAttrib).first;
+    std::vector<vec3> normals;
+    if (const auto buffer = dynamic_cast<const Buffer<vec3>*>(normalBuffer)) {
+        normals = buffer->getRAMRepresentation()->getDataContainer();
+    } else if (const auto encoded = dynamic_cast<const Buffer<glm::i16vec2>*>(normalBuffer)) {
+        for (const auto& n : encoded->getRAMRepresentation()->getDataContainer()) {
+            normals.push_back(util::decodeOctahedral(n));
+        }
+    }
+    const bool hasNormals = !normals.empty() && normals.size() == positions.size();
+    if (!hasNormals) {
+        normals.assign(positions.size(), vec3(0.0f));
+    }
+
+    // Triangles of all index buffers with the index buffer they came from
+    std::vector<Triangle> triangles;
+    std::vector<std::uint32_t> levels;
+    std::uint32_t levelCount = 0;
+    for (const auto& [info, buffer] : mesh.getIndexBuffers()) {
+        if (info.dt != DrawType::Triangles || info.ct != ConnectivityType::None) continue;
+        const auto& indices = buffer->getRAMRepresentation()->getDataContainer();
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            const Triangle t{indices[i], indices[i + 1], indices[i + 2]};
+            if (t[0] == t[1] || t[0] == t[2] || t[1] == t[2]) continue;
+            triangles.push_back(t);
+            levels.push_back(levelCount);
+        }
+        ++levelCount;
+    }
+
+    // Vertices on open or non-manifold edges are locked
+    std::vector<char> locked(positions.size(), 0);
+    {
+        std::vector<std::uint64_t> edges;
+        edges.reserve(3 * triangles.size());
+        for (const auto& t : triangles) {
+            for (size_t k = 0; k < 3; ++k) {
+                const std::uint64_t a = std::min(t[k], t[(k + 1) % 3]);
+                const std::uint64_t b = std::max(t[k], t[(k + 1) % 3]);
+                edges.push_back(a << 32 | b);
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size();) {
+            size_t j = i;
+            while (j < edges.size() && edges[j] == edges[i]) ++j;
+            if (j - i != 2) {
+                locked[edges[i] >> 32] = 1;
+                locked[edges[i] & 0xFFFFFFFFu] = 1;
+            }
+            i = j;
+        }
+    }
+
+    std::vector<Quadric> quadrics(positions.size());
+    for (const auto& t : triangles) {
+        const vec3 n = faceNormal(positions[t[0]], positions[t[1]], positions[t[2]]);
+        const float length = glm::length(n);
+        if (length == 0.0f) continue;
+        const auto q = Quadric::plane(n / length, positions[t[0]]);
+        for (auto v : t) quadrics[v] += q;
+    }
+
+    // Partitions of equally many triangles along the longest axis, ordered by their centroids
+    partitions = std::max(size_t{1}, std::min(partitions, triangles.size()));
+    vec3 lower(std::numeric_limits<float>::max());
+    vec3 upper(std::numeric_limits<float>::lowest());
+    for (const auto& p : positions) {
+        lower = glm::min(lower, p);
+        upper = glm::max(upper, p);
+    }
+    const vec3 extent = upper - lower;
+    const size_t axis =
+        extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+    std::vector<std::uint32_t> order(triangles.size());
+    std::iota(order.begin(), order.end(), 0);
+    const auto centroid = [&](std::uint32_t t) {
+        const auto& tri = triangles[t];
+        return positions[tri[0]][axis] + positions[tri[1]][axis] + positions[tri[2]][axis];
+    };
+    std::stable_sort(order.begin(), order.end(),
+                     [&](std::uint32_t a, std::uint32_t b) { return centroid(a) < centroid(b); });
+    std::vector<std::uint32_t> partitionOf(triangles.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        partitionOf[order[i]] = static_cast<std::uint32_t>(i * partitions / order.size());
+    }
+
+    // Vertices used by several partitions are locked
+    std::vector<char> shared(positions.size(), 0);
+    std::vector<std::uint32_t> vertexPartition(positions.size(), noVertex);
+    for (std::uint32_t t = 0; t < triangles.size(); ++t) {
+        for (auto v : triangles[t]) {
+            if (vertexPartition[v] == noVertex) {
+                vertexPartition[v] = partitionOf[t];
+            } else if (vertexPartition[v] != partitionOf[t]) {
+                locked[v] = 1;
+                shared[v] = 1;
+            }
+        }
+    }
+
+    // Local copies of the partitions, the triangles keep their original order
+    std::vector<std::vector<std::uint32_t>> partitionTriangles(partitions);
+    for (std::uint32_t t = 0; t < triangles.size(); ++t) {
+        partitionTriangles[partitionOf[t]].push_back(t);
+    }
+    std::vector<std::vector<std::uint32_t>> partitionVertices(partitions);
+    std::vector<Decimator> decimators;
+    decimators.reserve(partitions);
+    std::vector<std::uint32_t> local(positions.size(), noVertex);
+    for (size_t p = 0; p < partitions; ++p) {
+        auto& vertices = partitionVertices[p];
+        std::vector<Triangle> localTriangles;
+        localTriangles.reserve(partitionTriangles[p].size());
+        for (auto t : partitionTriangles[p]) {
+            Triangle tri;
+            for (size_t k = 0; k < 3; ++k) {
+                const auto v = triangles[t][k];
+                if (local[v] == noVertex) {
+                    local[v] = static_cast<std::uint32_t>(vertices.size());
+                    vertices.push_back(v);
+                }
+                tri[k] = local[v];
+            }
+            localTriangles.push_back(tri);
+        }
+
+        std::vector<vec3> localPositions;
+        std::vector<vec3> localNormals;
+        std::vector<Quadric> localQuadrics;
+        std::vector<char> localLocked;
+        std::vector<char> localShared;
+        for (auto v : vertices) {
+            localPositions.push_back(positions[v]);
+            localNormals.push_back(normals[v]);
+            localQuadrics.push_back(quadrics[v]);
+            localLocked.push_back(locked[v]);
+            localShared.push_back(shared[v]);
+            local[v] = noVertex;
+        }
+        decimators.emplace_back(std::move(localPositions), std::move(localNormals),
+                                std::move(localQuadrics), std::move(localLocked),
+                                std::move(localShared), std::move(localTriangles));
+    }
+
+    const double maxCost = maxError > 0.0f ? static_cast<double>(maxError) * maxError
+                                           : std::numeric_limits<double>::infinity();
+    std::vector<std::exception_ptr> errors(partitions);
+    const auto decimate = [&](size_t p) {
+        try {
+            const auto target = static_cast<size_t>(
+                std::ceil(static_cast<double>(targetRatio) * partitionTriangles[p].size()));
+            decimators[p].run(target, maxCost);
+        } catch (...) {
+            errors[p] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t p = 1; p < partitions; ++p) {
+        threads.emplace_back(decimate, p);
+    }
+    decimate(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+
+    // Merge the partitions, unlocked vertices belong to a single partition
+    std::vector<vec3> mergedPositions(positions.begin(), positions.end());
+    std::vector<std::vector<std::uint32_t>> indices(levelCount);
+    for (size_t p = 0; p < partitions; ++p) {
+        const auto& d = decimators[p];
+        const auto& vertices = partitionVertices[p];
+        for (size_t v = 0; v < vertices.size(); ++v) {
+            if (locked[vertices[v]]) continue;
+            mergedPositions[vertices[v]] = d.positions[v];
+            normals[vertices[v]] = d.normals[v];
+        }
+        for (size_t t = 0; t < d.triangles.size(); ++t) {
+            if (!d.alive[t]) continue;
+            auto& levelIndices = indices[levels[partitionTriangles[p][t]]];
+            for (auto v : d.triangles[t]) levelIndices.push_back(vertices[v]);
+        }
+    }
+
+    // Drop the removed vertices, keeping the order of the others
+    std::vector<std::uint32_t> remap(positions.size(), noVertex);
+    for (const auto& levelIndices : indices) {
+        for (auto v : levelIndices) remap[v] = 0;
+    }
+    std::uint32_t count = 0;
+    for (auto& v : remap) {
+        if (v != noVertex) v = count++;
+    }
+    for (auto& levelIndices : indices) {
+        for (auto& v : levelIndices) v = remap[v];
+    }
+
+    std::vector<vec3> outPositions(count);
+    std::vector<vec3> outNormals(count, vec3(0.0f));
+    for (size_t v = 0; v < remap.size(); ++v) {
+        if (remap[v] == noVertex) continue;
+        outPositions[remap[v]] = mergedPositions[v];
+        if (hasNormals) outNormals[remap[v]] = normals[v];
+    }
+    if (!hasNormals) {
+        for (const auto& levelIndices : indices) {
+            for (size_t i = 0; i + 2 < levelIndices.size(); i += 3) {
+                const vec3 n = faceNormal(outPositions[levelIndices[i]],
+                                          outPositions[levelIndices[i + 1]],
+                                          outPositions[levelIndices[i + 2]]);
+                for (size_t k = 0; k < 3; ++k) outNormals[levelIndices[i + k]] += n;
+            }
+        }
+        for (auto& n : outNormals) {
+            if (glm::length(n) > 0.0f) n = glm::normalize(n);
+        }
+    }
+
+    auto result = std::make_shared<BasicMesh>();
+    result->setModelMatrix(modelMatrix);
+    result->setWorldMatrix(mesh.getWorldMatrix());
+    std::vector<BasicMesh::Vertex> vertices;
+    vertices.reserve(count);
+    for (size_t v = 0; v < count; ++v) {
+        vertices.push_back(
+            {outPositions[v], outNormals[v], outPositions[v], vec4(0.7f, 0.7f, 0.7f, 1.0f)});
+    }
+    result->addVertices(vertices);
+    for (auto& levelIndices : indices) {
+        auto indexBuffer = result->addIndexBuffer(DrawType::Triangles, ConnectivityType::None);
+        indexBuffer->getDataContainer() = std::move(levelIndices);
+    }
+    return result;
+}
+
+}  // namespace util
+
+}  // namespace inviwo
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <modules/tnm067lab2/tnm067lab2moduledefine.h>
+
+#include <memory>
+
+namespace inviwo {
+
+class Mesh;
+class BasicMesh;
+
+namespace util {
+
+/**
+ * Simplifies the triangles of a mesh by quadric error edge collapses. The triangles are split
+ * into partitions of equal size along the longest axis of the mesh, which are decimated on
+ * separate threads. Vertices shared between partitions and vertices on open borders are locked,
+ * so the partitions fit together and the border of the mesh is kept.
+ *
+ * Collapses that would flip a triangle or make the mesh non-manifold are skipped. Every partition
+ * stops when it has targetRatio of its triangles left or, if maxError is larger than 0, when the
+ * next collapse would move the surface by more than about maxError.
+ *
+ * The mesh needs vec3 positions, or u16vec3 positions quantized over the unit cube like the
+ * quantized layout of MarchingTetrahedra, and triangle index buffers. The index buffers are
+ * decimated together but kept apart in the result. Quantized positions are dequantized, the
+ * result has vec3 positions and the model matrix is scaled to match. Normals are taken from a
+ * vec3 or octahedral (see util::encodeOctahedral) normal buffer if there is one, otherwise they
+ * are computed from the triangles. Throws an Exception if the mesh has other positions.
+ */
+IVW_MODULE_TNM067LAB2_API std::shared_ptr<BasicMesh> decimateMesh(const Mesh& mesh,
+                                                                  float targetRatio,
+                                                                  float maxError,
+                                                                  size_t partitions);
+
+}  // namespace util
+
+}  // namespace inviwo
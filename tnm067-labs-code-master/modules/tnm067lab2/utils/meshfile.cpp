@@ -0,0 +1,138 @@
+#include <modules/tnm067lab2/utils/meshfile.h>
+#include <modules/tnm067lab2/utils/mappedfile.h>
+#include <inviwo/core/datastructures/geometry/basicmesh.h>
+#include <inviwo/core/util/exception.h>
+
+#include <cstring>
+#include <filesystem>
+
+namespace inviwo {
+
+namespace {
+
+constexpr char magic[8] = {'T', 'N', 'M', 'M', 'E', 'S', 'H', '1'};
+constexpr size_t headerSize = sizeof(magic) + 2 * sizeof(std::uint64_t) + 2 * 16 * sizeof(float);
+
+template <typename T>
+void write(std::ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+}  // namespace
+
+MeshFileWriter::MeshFileWriter(const std::string& path, const mat4& modelMatrix,
+                               const mat4& worldMatrix)
+    : path_(path)
+    , tmpPath_(path + ".tmp")
+    , trianglesPath_(path + ".triangles.tmp")
+    , out_(tmpPath_, std::ios::binary)
+    , triangles_(trianglesPath_, std::ios::binary)
+    , vertexCount_(0)
+    , triangleCount_(0) {
+    if (!out_ || !triangles_) {
+        throw Exception("Could not write " + path, IVW_CONTEXT_CUSTOM("MeshFileWriter"));
+    }
+    // The counts are filled in by close
+    out_.write(magic, sizeof(magic));
+    write(out_, vertexCount_);
+    write(out_, triangleCount_);
+    write(out_, modelMatrix);
+    write(out_, worldMatrix);
+}
+
+MeshFileWriter::~MeshFileWriter() {
+    if (out_.is_open() || triangles_.is_open()) {
+        out_.close();
+        triangles_.close();
+        std::error_code ec;
+        std::filesystem::remove(tmpPath_, ec);
+        std::filesystem::remove(trianglesPath_, ec);
+    }
+}
+
+void MeshFileWriter::addVertices(const std::vector<vec3>& positions,
+                                 const std::vector<vec3>& normals) {
+    std::vector<vec3> vertices;
+    vertices.reserve(2 * positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        vertices.push_back(positions[i]);
+        vertices.push_back(normals[i]);
+    }
+    out_.write(reinterpret_cast<const char*>(vertices.data()),
+               static_cast<std::streamsize>(vertices.size() * sizeof(vec3)));
+    vertexCount_ += positions.size();
+}
+
+void MeshFileWriter::addTriangles(const std::vector<std::uint32_t>& indices) {
+    triangles_.write(reinterpret_cast<const char*>(indices.data()),
+                     static_cast<std::streamsize>(indices.size() * sizeof(std::uint32_t)));
+    triangleCount_ += indices.size() / 3;
+}
+
+void MeshFileWriter::close() {
+    triangles_.close();
+    {
+        std::ifstream in(trianglesPath_, std::ios::binary);
+        if (triangleCount_ > 0) {
+            out_ << in.rdbuf();
+        }
+    }
+    out_.seekp(sizeof(magic));
+    write(out_, vertexCount_);
+    write(out_, triangleCount_);
+    out_.close();
+    std::filesystem::remove(trianglesPath_);
+    if (!out_) {
+        std::filesystem::remove(tmpPath_);
+        throw Exception("Could not write " + path_, IVW_CONTEXT_CUSTOM("MeshFileWriter"));
+    }
+    std::filesystem::rename(tmpPath_, path_);
+}
+
+namespace util {
+
+std::shared_ptr<BasicMesh> readMeshFile(const std::string& path) {
+    MappedFile file(path);
+    const auto* data = static_cast<const char*>(file.data());
+
+    if (file.size() < headerSize || std::memcmp(data, magic, sizeof(magic)) != 0) {
+        throw Exception("Not a mesh file " + path, IVW_CONTEXT_CUSTOM("readMeshFile"));
+    }
+
+    std::uint64_t counts[2];
+    mat4 matrices[2];
+    std::memcpy(counts, data + sizeof(magic), sizeof(counts));
+    std::memcpy(matrices, data + sizeof(magic) + sizeof(counts), sizeof(matrices));
+    const size_t vertexBytes = counts[0] * 2 * sizeof(vec3);
+    const size_t triangleBytes = counts[1] * 3 * sizeof(std::uint32_t);
+    if (file.size() != headerSize + vertexBytes + triangleBytes) {
+        throw Exception("Size of " + path + " does not match its header",
+                        IVW_CONTEXT_CUSTOM("readMeshFile"));
+    }
+
+    auto mesh = std::make_shared<BasicMesh>();
+    mesh->setModelMatrix(matrices[0]);
+    mesh->setWorldMatrix(matrices[1]);
+
+    std::vector<BasicMesh::Vertex> vertices;
+    vertices.reserve(counts[0]);
+    const char* vertexData = data + headerSize;
+    for (size_t i = 0; i < counts[0]; ++i) {
+        vec3 vertex[2];
+        std::memcpy(vertex, vertexData + i * sizeof(vertex), sizeof(vertex));
+        vertices.push_back({vertex[0], vertex[1], vertex[0], vec4(0.7f, 0.7f, 0.7f, 1.0f)});
+    }
+    mesh->addVertices(vertices);
+
+    auto indexBuffer = mesh->addIndexBuffer(DrawType::Triangles, ConnectivityType::None);
+    auto& indices = indexBuffer->getDataContainer();
+    indices.resize(3 * counts[1]);
+    if (triangleBytes > 0) {
+        std::memcpy(indices.data(), vertexData + vertexBytes, triangleBytes);
+    }
+    return mesh;
+}
+
+}  // namespace util
+
+}  // namespace inviwo
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <modules/tnm067lab2/tnm067lab2moduledefine.h>
+#include <inviwo/core/util/glmvec.h>
+#include <inviwo/core/util/glmmat.h>
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace inviwo {
+
+class BasicMesh;
+
+/**
+ * \class MeshFileWriter
+ * \brief Writes a triangle mesh into a binary file in chunks
+ * The vertices are written to the file as they are added and the triangles to a temporary file
+ * that is appended by close, so memory is only needed for a single chunk. The file is moved into
+ * place by close. Layout, in native byte order:
+ *
+ *     char[8] "TNMMESH1", uint64 vertex count, uint64 triangle count,
+ *     float[16] model matrix, float[16] world matrix (column major),
+ *     vertex count x (vec3 position, vec3 normal), triangle count x uint32[3]
+ */
+class IVW_MODULE_TNM067LAB2_API MeshFileWriter {
+public:
+    MeshFileWriter(const std::string& path, const mat4& modelMatrix, const mat4& worldMatrix);
+    /**
+     * Removes the temporary files if close was not called
+     */
+    ~MeshFileWriter();
+    MeshFileWriter(const MeshFileWriter&) = delete;
+    MeshFileWriter& operator=(const MeshFileWriter&) = delete;
+
+    void addVertices(const std::vector<vec3>& positions, const std::vector<vec3>& normals);
+    /**
+     * Adds triangles as three vertex indices each, counted over all added vertices
+     */
+    void addTriangles(const std::vector<std::uint32_t>& indices);
+    void close();
+
+    std::uint64_t getVertexCount() const { return vertexCount_; }
+    std::uint64_t getTriangleCount() const { return triangleCount_; }
+
+private:
+    std::string path_;
+    std::string tmpPath_;
+    std::string trianglesPath_;
+    std::ofstream out_;
+    std::ofstream triangles_;
+    std::uint64_t vertexCount_;
+    std::uint64_t triangleCount_;
+};
+
+namespace util {
+
+/**
+ * Reads a mesh written by MeshFileWriter. Throws an Exception if the file is not a complete mesh
+ * file.
+ */
+IVW_MODULE_TNM067LAB2_API std::shared_ptr<BasicMesh> readMeshFile(const std::string& path);
+
+}  // namespace util
+
+}  // namespace inviwo
@@ -0,0 +1,156 @@
+#include <modules/tnm067lab2/utils/minmaxgrid.h>
+#include <inviwo/core/datastructures/volume/volumeram.h>
+#include <inviwo/core/datastructures/volume/volumeramprecision.h>
+#include <inviwo/core/util/formatdispatching.h>
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <numeric>
+#include <thread>
+
+namespace inviwo {
+
+namespace {
+
+// Voxels are hashed with a key of their position and summed over the block. Unlike a chained hash
+// the terms are independent of each other, which keeps the traversal fast.
+constexpr std::uint64_t positionKey = 0x9e3779b97f4a7c15ull;
+
+template <typename T>
+std::uint64_t hashVoxel(T value, std::uint64_t key) {
+    static_assert(sizeof(T) <= sizeof(std::uint64_t), "voxels should be scalars");
+    std::uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(T));
+    return (bits ^ key) * 0xff51afd7ed558ccdull;
+}
+
+}  // namespace
+
+MinMaxGrid::MinMaxGrid(const VolumeRAM& volume, bool trackChanges, size_t threads)
+    : trackChanges_(trackChanges), voxels_(0), dims_(0), ranges_(), hashes_(), activeBlocks_() {
+    computeBlocks(volume, threads, nullptr);
+}
+
+std::vector<size_t> MinMaxGrid::update(const VolumeRAM& volume, size_t threads) {
+    std::vector<size_t> changed;
+    if (volume.getDimensions() != voxels_ || !trackChanges_) {
+        computeBlocks(volume, threads, nullptr);
+        changed.resize(ranges_.size());
+        std::iota(changed.begin(), changed.end(), size_t{0});
+        return changed;
+    }
+
+    computeBlocks(volume, threads, &changed);
+    return changed;
+}
+
+void MinMaxGrid::computeBlocks(const VolumeRAM& volume, size_t threads,
+                               std::vector<size_t>* changed) {
+    if (!changed) {
+        voxels_ = volume.getDimensions();
+        dims_ = size3_t(0);
+        ranges_.clear();
+        hashes_.clear();
+        activeBlocks_ = IntervalTree();
+        if (glm::compMin(voxels_) < 2) {
+            return;
+        }
+        dims_ = (voxels_ - size3_t(1) + size3_t(blockSize - 1)) / blockSize;
+        ranges_.resize(dims_.x * dims_.y * dims_.z);
+        if (trackChanges_) {
+            hashes_.resize(ranges_.size());
+        }
+    } else if (ranges_.empty()) {
+        return;
+    }
+    const size3_t voxels = voxels_;
+    const size3_t cells = voxels - size3_t(1);
+
+    volume.dispatch<void, dispatching::filter::Scalars>([&](auto vrprecision) {
+        const auto* data = vrprecision->getDataTyped();
+
+        // The blocks of the layers [firstLayer, lastLayer), the changes are found in order
+        const auto computeLayers = [&](size_t firstLayer, size_t lastLayer,
+                                       std::vector<size_t>& layerChanges) {
+            size3_t block{};
+            for (block.z = firstLayer; block.z < lastLayer; ++block.z) {
+                for (block.y = 0; block.y < dims_.y; ++block.y) {
+                    for (block.x = 0; block.x < dims_.x; ++block.x) {
+                        const size_t blockIndex = block.x + dims_.x * (block.y + dims_.y * block.z);
+                        const size3_t first = block * blockSize;
+                        const size3_t last = glm::min(first + size3_t(blockSize), cells);
+
+                        float minValue = std::numeric_limits<float>::max();
+                        float maxValue = std::numeric_limits<float>::lowest();
+                        std::uint64_t h = 0;
+                        for (size_t z = first.z; z <= last.z; ++z) {
+                            for (size_t y = first.y; y <= last.y; ++y) {
+                                const size_t rowStart = voxels.x * (y + voxels.y * z);
+                                const auto* row = data + rowStart;
+                                for (size_t x = first.x; x <= last.x; ++x) {
+                                    const float value = static_cast<float>(row[x]);
+                                    minValue = std::min(minValue, value);
+                                    maxValue = std::max(maxValue, value);
+                                    if (trackChanges_) {
+                                        h += hashVoxel(row[x], (rowStart + x) * positionKey);
+                                    }
+                                }
+                            }
+                        }
+                        const vec2 range(minValue, maxValue);
+                        if (changed &&
+                            (ranges_[blockIndex] != range || hashes_[blockIndex] != h)) {
+                            layerChanges.push_back(blockIndex);
+                        }
+                        ranges_[blockIndex] = range;
+                        if (trackChanges_) {
+                            hashes_[blockIndex] = h;
+                        }
+                    }
+                }
+            }
+        };
+
+        // Contiguous layers per thread, so that the changes stay in order
+        threads = std::max(size_t{1}, std::min(threads, dims_.z));
+        std::vector<std::vector<size_t>> threadChanges(threads);
+        std::vector<std::exception_ptr> errors(threads);
+        const auto compute = [&](size_t thread) {
+            try {
+                computeLayers(dims_.z * thread / threads, dims_.z * (thread + 1) / threads,
+                              threadChanges[thread]);
+            } catch (...) {
+                errors[thread] = std::current_exception();
+            }
+        };
+        std::vector<std::thread> workers;
+        for (size_t thread = 1; thread < threads; ++thread) {
+            workers.emplace_back(compute, thread);
+        }
+        compute(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (const auto& error : errors) {
+            if (error) std::rethrow_exception(error);
+        }
+        if (changed) {
+            for (const auto& layerChanges : threadChanges) {
+                changed->insert(changed->end(), layerChanges.begin(), layerChanges.end());
+            }
+        }
+    });
+
+    activeBlocks_ = IntervalTree(ranges_);
+}
+
+std::vector<size_t> MinMaxGrid::getActiveBlocks(float iso) const {
+    std::vector<size_t> blocks;
+    activeBlocks_.query(iso, blocks);
+    std::sort(blocks.begin(), blocks.end());
+    return blocks;
+}
+
+}  // namespace inviwo
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <modules/tnm067lab2/tnm067lab2moduledefine.h>
+#include <inviwo/core/util/glmvec.h>
+#include <modules/tnm067lab2/utils/intervaltree.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace inviwo {
+
+class VolumeRAM;
+
+/**
+ * \class MinMaxGrid
+ * \brief Value ranges of the blocks of cells of a scalar volume
+ * The cells of the volume are grouped into blocks of blockSize^3 cells. The range of a block
+ * covers all voxels of its cells, i.e. blockSize + 1 voxels along each axis, so a block whose
+ * range excludes an iso value contains no part of that iso surface. Ranges are given in data
+ * space. An interval tree over the block ranges finds the active blocks of an iso value without
+ * visiting the others.
+ *
+ * If trackChanges is set every block also keeps a hash of the voxels of its cells, which update
+ * uses to find the blocks that changed between two versions of a volume.
+ */
+class IVW_MODULE_TNM067LAB2_API MinMaxGrid {
+public:
+    static constexpr size_t blockSize = 8;
+
+    /**
+     * @param threads the number of threads, see update
+     */
+    explicit MinMaxGrid(const VolumeRAM& volume, bool trackChanges = true, size_t threads = 1);
+
+    /**
+     * Recomputes the ranges and hashes for a new version of the volume and returns the linear
+     * indices of the blocks whose voxels changed, in increasing order. If the dimensions of the
+     * volume changed, or changes are not tracked, all blocks are returned. Volumes do not tell
+     * which voxels changed, so all voxels are read, split by layers of blocks over at most
+     * threads threads, and the blocks are compared in place.
+     */
+    std::vector<size_t> update(const VolumeRAM& volume, size_t threads = 1);
+    bool tracksChanges() const { return trackChanges_; }
+
+    /**
+     * Number of blocks along each axis
+     */
+    const size3_t& getDimensions() const { return dims_; }
+    const vec2& getRange(const size3_t& block) const {
+        return ranges_[block.x + dims_.x * (block.y + dims_.y * block.z)];
+    }
+    /**
+     * Returns true if the cells of the block can contain a part of the iso surface, i.e. if some
+     * voxel is below iso and some is not
+     */
+    bool isActive(const size3_t& block, float iso) const {
+        const vec2& range = getRange(block);
+        return range.x < iso && iso <= range.y;
+    }
+    /**
+     * Returns the linear indices (x fastest) of all active blocks in increasing order
+     */
+    std::vector<size_t> getActiveBlocks(float iso) const;
+
+private:
+    /**
+     * Computes the ranges and hashes of all blocks. If changed is given the dimensions have to be
+     * the same as before, and the blocks whose range or hash differ are added to it.
+     */
+    void computeBlocks(const VolumeRAM& volume, size_t threads, std::vector<size_t>* changed);
+
+    bool trackChanges_;
+    size3_t voxels_;
+    size3_t dims_;
+    std::vector<vec2> ranges_;
+    std::vector<std::uint64_t> hashes_;
+    IntervalTree activeBlocks_;
+};
+
+}  // namespace inviwo
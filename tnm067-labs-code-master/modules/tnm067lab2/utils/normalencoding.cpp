@@ -0,0 +1,49 @@
+#include <modules/tnm067lab2/utils/normalencoding.h>
+
+#include <cmath>
+
+namespace inviwo {
+
+namespace util {
+
+namespace {
+
+float signNotZero(float v) { return v >= 0.0f ? 1.0f : -1.0f; }
+
+std::int16_t toSnorm16(float v) {
+    return static_cast<std::int16_t>(std::round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f));
+}
+
+}  // namespace
+
+glm::i16vec2 encodeOctahedral(const vec3& normal) {
+    const float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (l1 == 0.0f) {
+        return glm::i16vec2(0, 0);
+    }
+    float x = normal.x / l1;
+    float y = normal.y / l1;
+    if (normal.z < 0.0f) {
+        const float fx = (1.0f - std::abs(y)) * signNotZero(x);
+        const float fy = (1.0f - std::abs(x)) * signNotZero(y);
+        x = fx;
+        y = fy;
+    }
+    return glm::i16vec2(toSnorm16(x), toSnorm16(y));
+}
+
+vec3 decodeOctahedral(const glm::i16vec2& encoded) {
+    vec3 n(encoded.x / 32767.0f, encoded.y / 32767.0f, 0.0f);
+    n.z = 1.0f - std::abs(n.x) - std::abs(n.y);
+    if (n.z < 0.0f) {
+        const float x = (1.0f - std::abs(n.y)) * signNotZero(n.x);
+        const float y = (1.0f - std::abs(n.x)) * signNotZero(n.y);
+        n.x = x;
+        n.y = y;
+    }
+    return glm::normalize(n);
+}
+
+}  // namespace util
+
+}  // namespace inviwo
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <modules/tnm067lab2/tnm067lab2moduledefine.h>
+#include <inviwo/core/util/glmvec.h>
+
+namespace inviwo {
+
+namespace util {
+
+/**
+ * Encodes a unit normal with the octahedral mapping into two signed normalized 16-bit values.
+ * The normal is projected onto the octahedron |x| + |y| + |z| = 1 and the lower half is folded
+ * over the upper one, which keeps the error below 1e-4 radians. A zero vector maps to (0, 0).
+ */
+IVW_MODULE_TNM067LAB2_API glm::i16vec2 encodeOctahedral(const vec3& normal);
+
+/**
+ * Decodes a normal encoded by encodeOctahedral, the result is normalized
+ */
+IVW_MODULE_TNM067LAB2_API vec3 decodeOctahedral(const glm::i16vec2& encoded);
+
+}  // namespace util
+
+}  // namespace inviwo
@@ -0,0 +1,293 @@
+#include <modules/tnm067lab2/utils/orbitalsurface.h>
+#include <modules/tnm067lab2/utils/hydrogenorbital.h>
+#include <modules/tnm067lab2/utils/tetrahedroncases.h>
+#include <inviwo/core/datastructures/geometry/basicmesh.h>
+#include <inviwo/core/util/exception.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace inviwo {
+
+namespace {
+
+// Leaves of the octree have 8^3 cells
+constexpr size_t leafDepth = 3;
+constexpr size_t leafSize = size_t{1} << leafDepth;
+constexpr size_t leafSamples = leafSize + 1;
+
+/**
+ * The finest grid of the octree, with cells + 1 samples along each axis
+ */
+struct Grid {
+    size_t cells;
+
+    float coordinate(size_t i) const {
+        return static_cast<float>(i) / static_cast<float>(cells) * 36.0f - 18.0f;
+    }
+    vec3 cartesian(const size3_t& p) const {
+        return vec3(coordinate(p.x), coordinate(p.y), coordinate(p.z));
+    }
+    std::uint64_t index(const size3_t& p) const {
+        const std::uint64_t samples = cells + 1;
+        return p.x + samples * (p.y + samples * p.z);
+    }
+};
+
+/**
+ * Collects the leaves below the node of size^3 cells at origin that can contain a part of the
+ * surface, i.e. whose density bounds include iso
+ */
+void findLeaves(const HydrogenOrbital& orbital, double iso, const Grid& grid, size3_t origin,
+                size_t size, std::vector<size3_t>& leaves) {
+    const vec3 boxMin = grid.cartesian(origin);
+    const vec3 boxMax = grid.cartesian(origin + size3_t(size));
+    // A cell has a part of the surface if some sample is below iso and some is not
+    if (orbital.maxDensity(boxMin, boxMax) < iso || orbital.minDensity(boxMin, boxMax) >= iso) {
+        return;
+    }
+    if (size == leafSize) {
+        leaves.push_back(origin);
+        return;
+    }
+    const size_t half = size / 2;
+    for (size_t child = 0; child < 8; ++child) {
+        const size3_t offset(child & 1, (child >> 1) & 1, child >> 2);
+        findLeaves(orbital, iso, grid, origin + offset * half, half, leaves);
+    }
+}
+
+/**
+ * Vertices and triangles of a range of leaves. Only vertices on the faces of the leaves can be
+ * shared with other leaves, these are identified across pieces by the key of their edge, see
+ * Piece::addVertex.
+ */
+struct Piece {
+    std::vector<vec3> positions;
+    std::vector<vec3> normals;
+    std::vector<std::uint32_t> indices;
+    // Vertices on the faces of the leaves with their keys, in the order of the vertices
+    std::vector<std::pair<std::uint32_t, std::uint64_t>> sharedVertices;
+    std::unordered_map<std::uint64_t, std::uint32_t> edgeToVertex;
+    std::unordered_map<std::uint64_t, std::uint32_t> leafEdgeToVertex;
+
+    /**
+     * Returns the vertex on the edge between the samples a and b of the grid, which have to be
+     * neighbors (also diagonally), and creates it if needed. The key of an edge is the index of
+     * its lower sample and the direction to the other one. Edges inside a leaf are only looked up
+     * until the next leaf is started.
+     */
+    template <typename F>
+    std::uint32_t addVertex(const Grid& grid, const size3_t& a, const size3_t& b, F vertex) {
+        const std::uint64_t ia = grid.index(a);
+        const std::uint64_t ib = grid.index(b);
+        const size3_t& lower = ia < ib ? a : b;
+        const size3_t& upper = ia < ib ? b : a;
+        const std::uint64_t direction = (upper.x + 1 - lower.x) + 3 * (upper.y + 1 - lower.y) +
+                                        9 * (upper.z + 1 - lower.z);
+        const std::uint64_t key = std::min(ia, ib) * 27 + direction;
+
+        bool shared = false;
+        for (int i = 0; i < 3; ++i) {
+            shared = shared || (lower[i] == upper[i] && lower[i] % leafSize == 0);
+        }
+        auto& vertices = shared ? edgeToVertex : leafEdgeToVertex;
+        const auto [it, inserted] =
+            vertices.try_emplace(key, static_cast<std::uint32_t>(positions.size()));
+        if (inserted) {
+            const auto [pos, normal] = vertex(lower, upper);
+            if (shared) {
+                sharedVertices.emplace_back(it->second, key);
+            }
+            positions.push_back(pos);
+            normals.push_back(normal);
+        }
+        return it->second;
+    }
+};
+
+/**
+ * Samples the leaf at origin and adds the triangles of its cells to piece
+ */
+void extractLeaf(const HydrogenOrbital& orbital, float iso, const Grid& grid,
+                 const size3_t& origin, Piece& piece) {
+    float values[leafSamples][leafSamples][leafSamples];
+    for (size_t z = 0; z < leafSamples; ++z) {
+        for (size_t y = 0; y < leafSamples; ++y) {
+            for (size_t x = 0; x < leafSamples; ++x) {
+                values[z][y][x] = static_cast<float>(
+                    orbital.density(grid.cartesian(origin + size3_t(x, y, z))));
+            }
+        }
+    }
+    const auto value = [&](const size3_t& p) {
+        const size3_t local = p - origin;
+        return values[local.z][local.y][local.x];
+    };
+    piece.leafEdgeToVertex.clear();
+
+    // Central differences of the density at the vertex, pointing towards lower values
+    const float h = 18.0f / static_cast<float>(grid.cells);
+    const auto vertex = [&](const size3_t& a, const size3_t& b) {
+        const float va = value(a);
+        const float s = (iso - va) / (value(b) - va);
+        const vec3 pa = vec3(a) / static_cast<float>(grid.cells);
+        const vec3 pb = vec3(b) / static_cast<float>(grid.cells);
+        const vec3 pos = pa + s * (pb - pa);
+
+        const vec3 p = pos * 36.0f - vec3(18.0f);
+        vec3 g;
+        for (int i = 0; i < 3; ++i) {
+            vec3 d(0.0f);
+            d[i] = h;
+            g[i] = static_cast<float>(orbital.density(p + d) - orbital.density(p - d));
+        }
+        const float length = glm::length(g);
+        return std::make_pair(pos, length > 0.0f ? -g / length : vec3(0.0f));
+    };
+
+    size3_t corners[8];
+    float cornerValues[8];
+    for (size_t z = 0; z < leafSize; ++z) {
+        for (size_t y = 0; y < leafSize; ++y) {
+            for (size_t x = 0; x < leafSize; ++x) {
+                unsigned below = 0;
+                for (size_t k = 0; k < 8; ++k) {
+                    corners[k] = origin + size3_t(x + (k & 1), y + ((k >> 1) & 1), z + (k >> 2));
+                    cornerValues[k] = value(corners[k]);
+                    below |= unsigned(cornerValues[k] < iso) << k;
+                }
+                if (below == 0 || below == 0xFF) {
+                    continue;
+                }
+
+                for (const auto& ids : detail::tetrahedraIds) {
+                    const unsigned caseId =
+                        ((below >> ids[0]) & 1u) << 3 | ((below >> ids[1]) & 1u) << 2 |
+                        ((below >> ids[2]) & 1u) << 1 | ((below >> ids[3]) & 1u);
+                    const auto& tetrahedronCase = detail::tetrahedronCases[caseId];
+                    for (size_t t = 0; t < tetrahedronCase.triangleCount; ++t) {
+                        for (size_t k = 0; k < 3; ++k) {
+                            const auto& edge =
+                                detail::tetrahedronEdges[tetrahedronCase.triangles[t][k]];
+                            piece.indices.push_back(piece.addVertex(
+                                grid, corners[ids[edge[0]]], corners[ids[edge[1]]], vertex));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
+
+namespace util {
+
+std::shared_ptr<BasicMesh> extractOrbitalSurface(const HydrogenOrbital& orbital, double iso,
+                                                 size_t depth, size_t threads) {
+    if (depth < leafDepth || depth > 16) {
+        throw Exception("Octree depth " + std::to_string(depth) + " is not within [" +
+                            std::to_string(leafDepth) + ", 16]",
+                        IVW_CONTEXT_CUSTOM("util::extractOrbitalSurface"));
+    }
+    const Grid grid{size_t{1} << depth};
+
+    std::vector<size3_t> leaves;
+    findLeaves(orbital, iso, grid, size3_t(0), grid.cells, leaves);
+
+    // Ranges of leaves are extracted in parallel and merged in order, so the result does not
+    // depend on the number of threads
+    const size_t pieceCount = std::max(size_t{1}, std::min(leaves.size(), size_t{256}));
+    std::vector<Piece> pieces(pieceCount);
+    threads = std::max(size_t{1}, std::min(threads, pieceCount));
+    std::atomic<size_t> nextPiece{0};
+    std::vector<std::exception_ptr> errors(threads);
+    const auto extract = [&](size_t thread) {
+        try {
+            for (size_t p = nextPiece++; p < pieceCount; p = nextPiece++) {
+                const size_t first = leaves.size() * p / pieceCount;
+                const size_t last = leaves.size() * (p + 1) / pieceCount;
+                for (size_t leaf = first; leaf < last; ++leaf) {
+                    extractLeaf(orbital, static_cast<float>(iso), grid, leaves[leaf], pieces[p]);
+                }
+                pieces[p].edgeToVertex = {};
+                pieces[p].leafEdgeToVertex = {};
+                pieces[p].positions.shrink_to_fit();
+                pieces[p].normals.shrink_to_fit();
+                pieces[p].indices.shrink_to_fit();
+            }
+        } catch (...) {
+            errors[thread] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t thread = 1; thread < threads; ++thread) {
+        workers.emplace_back(extract, thread);
+    }
+    extract(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+
+    // Weld the vertices that neighboring pieces share, which all lie on the faces of the leaves.
+    // Every piece is released once it is appended.
+    size_t vertexCount = 0;
+    size_t sharedCount = 0;
+    size_t indexCount = 0;
+    for (const auto& piece : pieces) {
+        vertexCount += piece.positions.size();
+        sharedCount += piece.sharedVertices.size();
+        indexCount += piece.indices.size();
+    }
+    std::unordered_map<std::uint64_t, std::uint32_t> keyToVertex;
+    keyToVertex.reserve(sharedCount);
+    std::vector<BasicMesh::Vertex> vertices;
+    vertices.reserve(vertexCount);
+    std::vector<std::uint32_t> indices;
+    indices.reserve(indexCount);
+    std::vector<std::uint32_t> remap;
+    for (auto& piece : pieces) {
+        remap.resize(piece.positions.size());
+        auto shared = piece.sharedVertices.begin();
+        for (size_t v = 0; v < piece.positions.size(); ++v) {
+            if (shared != piece.sharedVertices.end() && shared->first == v) {
+                const auto [it, inserted] = keyToVertex.try_emplace(
+                    shared->second, static_cast<std::uint32_t>(vertices.size()));
+                ++shared;
+                if (!inserted) {
+                    remap[v] = it->second;
+                    continue;
+                }
+            }
+            remap[v] = static_cast<std::uint32_t>(vertices.size());
+            vertices.push_back({piece.positions[v], piece.normals[v], piece.positions[v],
+                                vec4(0.7f, 0.7f, 0.7f, 1.0f)});
+        }
+        for (const auto index : piece.indices) {
+            indices.push_back(remap[index]);
+        }
+        piece = Piece{};
+    }
+
+    auto mesh = std::make_shared<BasicMesh>();
+    mesh->setModelMatrix(HydrogenOrbital::modelMatrix());
+    mesh->addVertices(vertices);
+    auto indexBuffer = mesh->addIndexBuffer(DrawType::Triangles, ConnectivityType::None);
+    indexBuffer->getDataContainer() = std::move(indices);
+    return mesh;
+}
+
+}  // namespace util
+
+}  // namespace inviwo
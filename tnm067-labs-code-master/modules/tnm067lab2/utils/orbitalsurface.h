@@ -0,0 +1,31 @@
+#pragma once
+
+#include <modules/tnm067lab2/tnm067lab2moduledefine.h>
+
+#include <memory>
+
+namespace inviwo {
+
+class BasicMesh;
+class HydrogenOrbital;
+
+namespace util {
+
+/**
+ * Extracts the iso surface where the density of the orbital equals iso, without sampling a dense
+ * volume. The [-18, 18]^3 domain of HydrogenGenerator is subdivided as an octree down to
+ * 2^depth cells per axis. Nodes whose density bounds exclude iso are skipped, see
+ * HydrogenOrbital::minDensity and HydrogenOrbital::maxDensity, and the remaining leaves of 8^3
+ * cells are sampled and triangulated with marching tetrahedra on separate threads. All cells the
+ * surface crosses have the finest size, so the leaves fit together without cracks. The normals
+ * are central differences of the density at the vertices.
+ *
+ * The positions lie in [0, 1]^3 and the mesh is placed like a volume of HydrogenGenerator.
+ * Throws an Exception if depth is below 3 or above 16.
+ */
+IVW_MODULE_TNM067LAB2_API std::shared_ptr<BasicMesh> extractOrbitalSurface(
+    const HydrogenOrbital& orbital, double iso, size_t depth, size_t threads);
+
+}  // namespace util
+
+}  // namespace inviwo
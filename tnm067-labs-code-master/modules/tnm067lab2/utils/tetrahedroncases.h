@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+namespace inviwo {
+
+// Tetrahedra and their triangulation cases, shared by the iso surface extractors. The voxels of
+// a cell are numbered with x = k & 1, y = (k >> 1) & 1 and z = k >> 2.
+namespace detail {
+
+// The six tetrahedra of a cell around the diagonal from voxel 5 to voxel 2, all positively
+// oriented
+inline constexpr size_t tetrahedraIds[6][4] = {{0, 1, 2, 5}, {1, 3, 2, 5}, {3, 2, 5, 7},
+                                               {0, 2, 4, 5}, {6, 4, 2, 5}, {6, 7, 5, 2}};
+
+// The six edges of a tetrahedron as pairs of its vertices
+inline constexpr size_t tetrahedronEdges[6][2] = {{0, 1}, {0, 2}, {0, 3}, {1, 2}, {1, 3}, {2, 3}};
+
+struct TetrahedronCase {
+    size_t triangleCount;
+    size_t triangles[2][3];  // indices into tetrahedronEdges
+};
+
+/**
+ * Generates the triangles of the 16 cases of a positively oriented tetrahedron. Bit 3 - i of the
+ * case is set if vertex i is below the iso value, and the triangles face the vertices below.
+ */
+constexpr std::array<TetrahedronCase, 16> makeTetrahedronCases() {
+    struct Point {
+        float x, y, z;
+    };
+    constexpr Point corners[4] = {{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    const auto sub = [](Point a, Point b) { return Point{a.x - b.x, a.y - b.y, a.z - b.z}; };
+    const auto add = [](Point a, Point b) { return Point{a.x + b.x, a.y + b.y, a.z + b.z}; };
+    const auto dot = [](Point a, Point b) { return a.x * b.x + a.y * b.y + a.z * b.z; };
+    const auto cross = [](Point a, Point b) {
+        return Point{a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+    };
+    const auto edge = [](size_t a, size_t b) {
+        size_t e = 0;
+        while (tetrahedronEdges[e][0] != std::min(a, b) ||
+               tetrahedronEdges[e][1] != std::max(a, b)) {
+            ++e;
+        }
+        return e;
+    };
+    const auto midpoint = [&](size_t e) {
+        const Point a = corners[tetrahedronEdges[e][0]];
+        const Point b = corners[tetrahedronEdges[e][1]];
+        return Point{(a.x + b.x) / 2, (a.y + b.y) / 2, (a.z + b.z) / 2};
+    };
+
+    std::array<TetrahedronCase, 16> cases{};
+    for (size_t caseId = 0; caseId < 16; ++caseId) {
+        size_t below[4] = {};
+        size_t above[4] = {};
+        size_t belowCount = 0;
+        size_t aboveCount = 0;
+        Point belowCenter{0, 0, 0};
+        for (size_t i = 0; i < 4; ++i) {
+            if ((caseId >> (3 - i)) & 1) {
+                below[belowCount++] = i;
+                belowCenter = add(belowCenter, corners[i]);
+            } else {
+                above[aboveCount++] = i;
+            }
+        }
+
+        auto& c = cases[caseId];
+        if (belowCount == 1 || belowCount == 3) {
+            // One vertex is separated from the other three
+            const size_t* single = belowCount == 1 ? below : above;
+            const size_t* others = belowCount == 1 ? above : below;
+            c.triangleCount = 1;
+            for (size_t k = 0; k < 3; ++k) {
+                c.triangles[0][k] = edge(single[0], others[k]);
+            }
+        } else if (belowCount == 2) {
+            // The quad between the two pairs
+            const size_t quad[4] = {edge(below[0], above[0]), edge(below[0], above[1]),
+                                    edge(below[1], above[1]), edge(below[1], above[0])};
+            c.triangleCount = 2;
+            for (size_t k = 0; k < 3; ++k) {
+                c.triangles[0][k] = quad[k];
+                c.triangles[1][k] = quad[(k + 2) % 4];
+            }
+        }
+
+        for (size_t t = 0; t < c.triangleCount; ++t) {
+            auto& triangle = c.triangles[t];
+            const Point a = midpoint(triangle[0]);
+            const Point n = cross(sub(midpoint(triangle[1]), a), sub(midpoint(triangle[2]), a));
+            const Point towardsBelow =
+                sub(Point{belowCenter.x / belowCount, belowCenter.y / belowCount,
+                          belowCenter.z / belowCount},
+                    a);
+            if (dot(n, towardsBelow) < 0) {
+                const size_t tmp = triangle[1];
+                triangle[1] = triangle[2];
+                triangle[2] = tmp;
+            }
+        }
+    }
+    return cases;
+}
+
+inline constexpr std::array<TetrahedronCase, 16> tetrahedronCases = makeTetrahedronCases();
+
+}  // namespace detail
+
+}  // namespace inviwo